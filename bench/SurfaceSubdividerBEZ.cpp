@@ -0,0 +1,57 @@
+// Copyright 2017
+//   Pawel Herman - Karlsruhe Institute of Technology - pherman@ira.uka.de
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+//NOTE: Times the subdivision of random patches of degree three to six.  Only SurfaceSubdividerBEZ::subdivide(nSubdivisions) is used, which already existed before the subdivision kernels were generated at compile time, so the same file builds against earlier versions of the subdivider and the numbers can be compared between commits.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "happah/utils/SurfaceSubdividerBEZ.h"
+
+using namespace happah;
+
+template<hpuint degree>
+void run(hpuint nSubdivisions, hpuint nPatches, hpuint nRepetitions) {
+     static constexpr hpuint nControlPoints = SurfaceUtilsBEZ::get_number_of_control_points<degree>::value;
+
+     std::mt19937 generator(degree);
+     std::uniform_real_distribution<hpreal> distribution(-1.0, 1.0);
+     std::vector<Point3D> controlPoints(nPatches * nControlPoints);
+     for(auto& point : controlPoints) point = Point3D(distribution(generator), distribution(generator), distribution(generator));
+
+     //NOTE: The fastest of the repetitions is reported; the sum keeps the compiler from dropping the work.
+     auto best = std::numeric_limits<double>::infinity();
+     auto sum = 0.0;
+     for(hpuint r = 0; r < nRepetitions; ++r) {
+          auto start = std::chrono::steady_clock::now();
+          for(hpuint p = 0; p < nPatches; ++p) {
+               SurfaceSubdividerBEZ<Space3D, degree> subdivider(controlPoints.begin() + p * nControlPoints);
+               auto subdivided = subdivider.subdivide(nSubdivisions);
+               sum += std::get<0>(subdivided).back().x;
+          }
+          best = std::min(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / nPatches);
+     }
+     std::cout << "degree " << degree << ", " << nSubdivisions << " subdivisions: " << best << " ns per patch (" << sum << ")\n";
+}
+
+template<hpuint degree>
+void run() {
+     run<degree>(1, 20000, 10);
+     run<degree>(2, 5000, 10);
+     run<degree>(3, 1000, 10);
+}
+
+int main() {
+     run<3>();
+     run<4>();
+     run<5>();
+     run<6>();
+     return 0;
+}
+
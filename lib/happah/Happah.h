@@ -51,6 +51,8 @@ namespace happah {
 
 constexpr hpreal EPSILON = 1e-5;
 constexpr hpuint UNULL = -1;
+template<class Index>
+constexpr Index INULL = -1;//NOTE: UNULL for indices of other widths.
 
 using Indices = std::vector<hpuint>;
 
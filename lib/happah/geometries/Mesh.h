@@ -6,6 +6,7 @@
 #pragma once
 
 #include <boost/optional.hpp>
+#include <set>
 #include <vector>
 
 #include "happah/Happah.h"
@@ -14,24 +15,50 @@
 
 namespace happah { 
 
+/*
+ * @section DESCRIPTION
+ *
+ * Changes list the vertices, edges, and triangles a mutation of a mesh added or
+ * modified.  Caches derived from a mesh can be updated from the changes in time
+ * proportional to the size of the changes instead of being recreated.  Moves are
+ * pairs of old and new edge indices and have to be applied in the given order; all
+ * other indices refer to the mesh after the mutation.
+ */
+struct MeshChanges {
+     Indices edges;//NOTE: Edges that were added or whose next, opposite, previous, or vertex changed.
+     std::vector<std::pair<hpuint, hpuint> > moves;
+     Indices triangles;//NOTE: Triangles that were added or whose indices changed.
+     Indices vertices;//NOTE: Vertices that were added or whose one-ring changed.
+};
+
 /*
  * @section DESCRIPTION
  *
  * A mesh is a set of patches.  All patches have the same number of vertices. For
- * example, a triangle mesh consists of patches that are triangles.
+ * example, a triangle mesh consists of patches that are triangles.  With
+ * MappedStorage, the vertices and indices are read-only views of a memory-mapped
+ * file.  The index type decides how many vertices a mesh can have; narrower
+ * indices save memory and bandwidth for small meshes.
  */
 
-template<class Vertex>
-class Mesh : public Model<Vertex> {
+template<class Vertex, class Storage = HeapStorage, class Index = hpuint>
+class Mesh : public Model<Vertex, Storage> {
 public:
-     using IndicesArrays = Arrays<hpuint>;
-     using Vertices = typename Model<Vertex>::Vertices;
+     using INDEX = Index;
+     using Indices = typename Storage::template Array<Index>;
+     using IndicesArrays = Arrays<Index>;
+     using Vertices = typename Model<Vertex, Storage>::Vertices;
 
      Mesh(Vertices vertices, Indices indices)
-          : Model<Vertex>(std::move(vertices)), m_indices(std::move(indices)), m_loops(boost::none) {}
+          : Model<Vertex, Storage>(std::move(vertices)), m_indices(std::move(indices)), m_loops(boost::none), m_version(0) {}
 
      virtual ~Mesh() {}
 
+     void clearChanges() { m_changes.clear(); }
+
+     //NOTE: The changes made since version getVersion() - getChanges().size().
+     const std::vector<MeshChanges>& getChanges() const { return m_changes; }
+
      boost::optional<hpuint> getGenus() const {
           if(m_loops) return m_loops->size() >> 1;
           else return boost::none;
@@ -43,14 +70,55 @@ public:
 
      Indices& getIndices() { return m_indices; }
 
+     hpuint getVersion() const { return m_version; }
+
+     //NOTE: Releases a version retained with retainChanges.
+     void releaseChanges(hpuint version) const {
+          auto i = m_readers.find(version);
+          assert(i != m_readers.end());
+          m_readers.erase(i);
+     }
+
+     //NOTE: Keeps the changes made since the given version until the version is released; a reader that replays the changes with visit_changes retains the version it has seen.
+     void retainChanges(hpuint version) const { m_readers.insert(version); }
+
      void setHandleTunnelLoops(IndicesArrays loops) { m_loops = std::move(loops); }
 
 protected:
+     //NOTE: The readers of a mesh refer to the original, so a copy starts without them.
+     struct Readers : public std::multiset<hpuint> {
+          Readers() {}
+          Readers(const Readers&) {}
+          Readers& operator=(const Readers&) { return *this; }
+     };
+
+     //NOTE: The log only keeps the changes some retained version has not seen yet and, if no version is retained, the last changes.  Readers that do not retain their version may find their changes trimmed, in which case visit_changes returns false.
+     std::vector<MeshChanges> m_changes;
      Indices m_indices;
      boost::optional<IndicesArrays> m_loops;
+     mutable Readers m_readers;
+     hpuint m_version;
+
+     void addChanges(MeshChanges changes) {
+          auto first = m_version - m_changes.size();
+          auto last = (m_readers.empty()) ? m_version : *m_readers.begin();
+          if(last > first) m_changes.erase(m_changes.begin(), m_changes.begin() + (last - first));
+          m_changes.push_back(std::move(changes));
+          ++m_version;
+     }
 
 };
 
+//NOTE: Visits the changes made to the mesh since the given version and returns false if some of them have been cleared, in which case caches have to be recreated.
+template<class Mesh, class Visitor>
+bool visit_changes(const Mesh& mesh, hpuint version, Visitor&& visit) {
+     auto& changes = mesh.getChanges();
+     auto first = mesh.getVersion() - changes.size();
+     if(version < first) return false;
+     for(auto i = changes.cbegin() + (version - first), end = changes.cend(); i != end; ++i) visit(*i);
+     return true;
+}
+
 template<class M, class Space = typename M::SPACE, class Vertex = typename M::VERTEX>
 struct is_mesh : std::integral_constant<bool, std::is_base_of<Mesh<Vertex>, M>::value && std::is_base_of<typename M::SPACE, Space>::value> {};
 
@@ -8,14 +8,16 @@
 #include <vector>
 
 #include "happah/geometries/Vertex.h"
+#include "happah/utils/MappedArray.h"
 
-template<class Vertex>
+//NOTE: The storage policy decides where the vertices are kept; see happah::HeapStorage and happah::MappedStorage.
+template<class Vertex, class Storage = happah::HeapStorage>
 class Model {
      static_assert(is_vertex<Vertex>::value, "A model can only be parameterized by a vertex.");
 
 public:
      using VERTEX = Vertex;
-     using Vertices = std::vector<Vertex>;
+     using Vertices = typename Storage::template Array<Vertex>;
 
      virtual ~Model() {}
 
@@ -23,17 +25,17 @@ public:
 
      const Vertex& getVertex(hpuint index) const { return m_vertices[index]; }
 
-     Vertex& getVertex(hpuint index) { return m_vertices[index]; }
+     auto& getVertex(hpuint index) { return m_vertices[index]; }//NOTE: Vertices in mapped storage are read-only.
 
      const Vertices& getVertices() const { return m_vertices; }
 
      Vertices& getVertices() { return m_vertices; }
 
-     Vertices getVertices(const std::vector<hpuint>& indices) const { return getVertices(indices.begin(), indices.end()); }
+     std::vector<Vertex> getVertices(const std::vector<hpuint>& indices) const { return getVertices(indices.begin(), indices.end()); }
 
      template<class Iterator>
-     Vertices getVertices(Iterator begin, Iterator end) const {
-          Vertices vertices;
+     std::vector<Vertex> getVertices(Iterator begin, Iterator end) const {
+          std::vector<Vertex> vertices;
           vertices.reserve(std::distance(begin, end));
           while(begin != end) {
                vertices.push_back(m_vertices[*begin]);
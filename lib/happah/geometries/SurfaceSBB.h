@@ -6,105 +6,84 @@
 #pragma once
 
 #include <array>
+#include <cilk/cilk.h>
 #include <functional>
+#include <map>
+#include <tuple>
+#include <vector>
 
 #include "happah/Happah.h"
-#include "happah/geometries/Manifold3HEZ.h"
+#include "happah/geometries/Sphere.h"
 #include "happah/geometries/Surface.h"
 #include "happah/geometries/TriangleMesh.h"
+#include "happah/math/MathUtils.h"
 #include "happah/utils/SurfaceUtilsBEZ.h"
+#include "happah/utils/VertexFactory.h"
 
+namespace happah {
+
+//NOTE: Spherical Bernstein-B\'ezier patch over the spherical triangle whose corners are given in spherical coordinates.  The patch is evaluated at the spherical barycentric coordinates of a point on the sphere, that is, the coefficients of the point in the basis of the corners.
 template<class Space, hpuint t_degree>
 class SurfaceSBB : public Surface<Space> {
-     typedef typename Space::POINT Point;
+     using Point = typename Space::POINT;
 
 public:
-     typedef SurfaceUtilsBEZ::ControlPoints<Space> ControlPoints;
+     using ControlPoints = SurfaceUtilsBEZ::ControlPoints<Space>;
 
      static const hpuint NUMBER_OF_CONTROL_POINTS = SurfaceUtilsBEZ::get_number_of_control_points<t_degree>::value;
      static const hpuint NUMBER_OF_CONTROL_POLYGON_TRIANGLES = SurfaceUtilsBEZ::get_number_of_control_polygon_triangles<t_degree>::value;
 
-     SurfaceSBB(const Manifold3HEZ<Space, t_degree>& manifold)
-          : m_manifold(manifold) {
-          auto ps = m_manifold.getParameterTriangle();
-          m_p0 = Sphere::Utils::getAbscissa(std::get<0>(ps));
-          m_p1 = Sphere::Utils::getAbscissa(std::get<1>(ps));
-          m_p2 = Sphere::Utils::getAbscissa(std::get<2>(ps));
-     }
      //TODO: getparameterVertex in surfaces
      //NOTE: Here we use spherical coordinates.
      //NOTE: There exist two triangles on the sphere associated with the given vertices.
      //TODO: rethink last note and behavior at ends of parameter space
      SurfaceSBB(const Point2D& p0, const Point2D& p1, const Point2D& p2)
-          : SurfaceSBB(p0, p1, p2, ControlPoints()) {}
+          : SurfaceSBB(p0, p1, p2, ControlPoints(NUMBER_OF_CONTROL_POINTS, Point(0.0))) {}
 
-     SurfaceSBB(const Point2D& p0, const Point2D& p1, const Point2D& p2, const ControlPoints& controlPoints)
-          : m_manifold(Sphere::Utils::getPoint(p0), Sphere::Utils::getPoint(p1), Sphere::Utils::getPoint(p2), controlPoints), m_p0(p0), m_p1(p1), m_p2(p2) {}
+     SurfaceSBB(const Point2D& p0, const Point2D& p1, const Point2D& p2, ControlPoints controlPoints)
+          : m_controlPoints(std::move(controlPoints)), m_p0(p0), m_p1(p1), m_p2(p2), m_corners{ Sphere::Utils::getPoint(p0), Sphere::Utils::getPoint(p1), Sphere::Utils::getPoint(p2) }, m_inverse(glm::inverse(hpmat3x3(m_corners[0], m_corners[1], m_corners[2]))) {}
 
      template<hpuint t_i0, hpuint t_i1, hpuint t_i2>
-     const Point& getControlPoint() const { return m_manifold.getControlPoint<t_i0, t_i1, t_i2>(); }
-     const Point& getControlPoint(hpuint i0, hpuint i1, hpuint i2) const { return m_manifold.getControlPoint(i0, i1, i2); }
+     const Point& getControlPoint() const { return m_controlPoints[SurfaceUtilsBEZ::get_index<t_degree, t_i0, t_i1, t_i2>::value]; }
+
+     const Point& getControlPoint(hpuint i0, hpuint i1, hpuint i2) const { return m_controlPoints[SurfaceUtilsBEZ::template getIndex<t_degree>(i0, i1, i2)]; }
+
+     const ControlPoints& getControlPoints() const { return m_controlPoints; }
+
+     //NOTE: Corners of the parameter triangle on the unit sphere.
+     const std::array<Point3D, 3>& getCorners() const { return m_corners; }
+
      std::tuple<const Point2D&, const Point2D&, const Point2D&> getParameterTriangle() const { return std::make_tuple(std::cref(m_p0), std::cref(m_p1), std::cref(m_p2)); }
+
      Point getPoint(const Point2D& p) const { return getPoint(p.x, p.y); }
-     Point getPoint(hpreal u, hpreal v) const { return m_manifold.getPoint(Sphere::Utils::getPoint(u, v)); }
-     template<hpuint t_i0, hpuint t_i1, hpuint t_i2>
-     void setControlPoint(const Point& controlPoint) { m_manifold.setControlPoint<t_i0, t_i1, t_i2>(controlPoint); }
-     void setControlPoint(hpuint i0, hpuint i1, hpuint i2, const Point& controlPoint) { m_manifold.setControlPoint(i0, i1, i2, controlPoint); }
-     void setControlPoints(const ControlPoints& controlPoints) { m_manifold.setControlPoints(controlPoints); }
-     //NOTE: nSamples is the number of samples on one edge of the parameter triangle.
-     template<class Vertex = VertexP<Space>, typename = typename std::enable_if<(t_degree > 0)>::type>
-     TriangleMesh<Vertex>* toTriangleMesh(hpuint nSamples = 100) const {
-          hpuint pseudodegree = nSamples - 1;
-          auto pt = m_manifold.getParameterTriangle();
-          auto factory = [&](hpreal u, hpreal v, hpreal w) {
-               Point3D abscissa = u * std::get<0>(pt) + v * std::get<1>(pt) + w * std::get<2>(pt);
-               return build_vertex<Vertex>::exec(Sphere::Utils::getAbscissa(abscissa), m_manifold.getPoint(abscissa));
-          };
-          std::vector<Vertex>* vertices = SurfaceUtilsBEZ::sample<Vertex>(pseudodegree, factory);
-          std::vector<hpuint>* indices = new std::vector<hpuint>();
-          indices->reserve(3 * SurfaceUtilsBEZ::getNumberOfControlPolygonTriangles(pseudodegree));
-
-          //TODO: move to SurfaceUtilsBEZ
-          //TODO: arrange vertices in counterclockwise order
-          //TODO: arrange provoking vertices correctly, if not too difficult
-          hpuint index = 0, nPointsInRow = nSamples;
-          for(hpuint row = 0; row < (nSamples - 1); ++row) {
-               for(hpuint i = 0; i < (2 * nPointsInRow - 3); ++i) {
-                    if(i % 2 == 0) {
-                         indices->push_back(index);
-                         indices->push_back(++index);
-                         indices->push_back(index + nPointsInRow - 1);
-                    } else {
-                         indices->push_back(index);
-                         indices->push_back(index + nPointsInRow);
-                         indices->push_back(index + nPointsInRow - 1);
-                    }
-               }
-               --nPointsInRow;
-               ++index;
-          }
 
-          return new TriangleMesh<Vertex>(vertices, indices);
+     Point getPoint(hpreal u, hpreal v) const { return getPoint(Sphere::Utils::getPoint(u, v)); }
+
+     //NOTE: The position does not have to be normalized; the patch is homogeneous of degree t_degree in it.
+     Point getPoint(const Point3D& position) const {
+          auto b = m_inverse * position;
+          return SurfaceUtilsBEZ::template evaluate<Space, t_degree>(b.x, b.y, b.z, m_controlPoints);
      }
 
-private:
-     Manifold3HEZ<Space, t_degree> m_manifold;
-     Point2D m_p0, m_p1, m_p2;
+     template<hpuint t_i0, hpuint t_i1, hpuint t_i2>
+     void setControlPoint(const Point& controlPoint) { m_controlPoints[SurfaceUtilsBEZ::get_index<t_degree, t_i0, t_i1, t_i2>::value] = controlPoint; }
+
+     void setControlPoint(hpuint i0, hpuint i1, hpuint i2, const Point& controlPoint) { m_controlPoints[SurfaceUtilsBEZ::template getIndex<t_degree>(i0, i1, i2)] = controlPoint; }
 
-     template<class Vertex, typename = void>
-     struct build_vertex;
+     void setControlPoints(ControlPoints controlPoints) { m_controlPoints = std::move(controlPoints); }
 
-     template<class Vertex>
-     struct build_vertex<Vertex, typename enable_if_absolute_vertex<Vertex>::type> {
-          static Vertex exec(const Point2D& abscissa, const Point1D& ordinate) { return VertexFactory<Vertex>::build(Sphere::Utils::getPoint(abscissa, ordinate)); }
-     };
+     //NOTE: See make_triangle_mesh below.
+     template<class Vertex = VertexP<Space3D>, class VertexFactory = happah::VertexFactory<Vertex> >
+     TriangleMesh<Vertex> toTriangleMesh(hpuint nSamples = 100, VertexFactory&& factory = VertexFactory()) const { return make_triangle_mesh<t_degree, Vertex>(*this, nSamples, std::forward<VertexFactory>(factory)); }
 
-     template<class Vertex>
-     struct build_vertex<Vertex, typename enable_if_relative_vertex<Vertex>::type> {
-          static Vertex exec(const Point2D& abscissa, const Point1D& ordinate) { return VertexFactory<Vertex>::build(abscissa, ordinate); }
-     };
+private:
+     //NOTE: Order is bn00 bn-110 bn-220 ... bn-101 bn-211 ... bn-202 bn-212 ... b00n.
+     ControlPoints m_controlPoints;
+     Point2D m_p0, m_p1, m_p2;
+     std::array<Point3D, 3> m_corners;
+     hpmat3x3 m_inverse;
 
-};
+};//SurfaceSBB
 template<class Space>
 using ConstantSurfaceSBB = SurfaceSBB<Space, 0>;
 template<class Space>
@@ -116,3 +95,114 @@ using QuadraticSurfaceSBB = SurfaceSBB<Space, 2>;
 template<class Space>
 using QuarticSurfaceSBB = SurfaceSBB<Space, 4>;
 
+//NOTE: Vertex of a sample on a spherical patch, given the unit direction of the sample and its distance from the unit sphere.
+template<class Vertex, class VertexFactory>
+typename std::enable_if<is_absolute_vertex<Vertex>::value, Vertex>::type make_spherical_vertex(const Point3D& direction, const Point1D& ordinate, VertexFactory& factory) { return factory((hpreal(1.0) + ordinate.x) * direction); }
+
+template<class Vertex, class VertexFactory>
+typename std::enable_if<is_relative_vertex<Vertex>::value, Vertex>::type make_spherical_vertex(const Point3D& direction, const Point1D& ordinate, VertexFactory& factory) { return factory(Sphere::Utils::getAbscissa(direction), ordinate); }
+
+/**
+ * Sample the patches of a spherical spline, for example, a spherical Clough-Tocher spline, on the same grid of nSamples samples per edge of the parameter triangle and connect the samples into one mesh.  The ordinate of a sample is its distance from the unit sphere; absolute vertices are built from the position (1 + ordinate) * direction and relative vertices from the spherical coordinates of the direction and the ordinate.
+ * The Bernstein polynomials are evaluated at the grid once for all patches.  At the sample with planar barycentric coordinates (u, v, w), a patch points in the direction of x = u * c0 + v * c1 + w * c2, where c0, c1, and c2 are its corners, and its spherical barycentric coordinates are (u, v, w) / |x|; because the patch is homogeneous, its ordinate is the planar Bernstein sum divided by |x|^degree, so evaluating a patch needs no trigonometry.  Patches whose parameter triangles share corners share the samples at those corners and on the edges between them.  The patches are sampled in parallel.
+ */
+template<hpuint degree, class Vertex = VertexP<Space3D>, class VertexFactory = happah::VertexFactory<Vertex>, typename = typename std::enable_if<(degree > 0)>::type>
+TriangleMesh<Vertex> make_triangle_mesh(const std::vector<SurfaceSBB<Space1D, degree> >& surfaces, hpuint nSamples, VertexFactory&& factory = VertexFactory()) {
+     static constexpr hpuint nControlPoints = SurfaceUtilsBEZ::get_number_of_control_points<degree>::value;
+     assert(nSamples > 1);
+
+     auto& matrix = SurfaceUtilsBEZ::getCachedEvaluationMatrix<degree>(nSamples);
+     hpuint nPatches = surfaces.size();
+     hpuint nSegments = nSamples - 1;
+     auto nPatchPoints = SurfaceUtilsBEZ::getNumberOfControlPoints(nSegments);
+     auto nInteriorPoints = nPatchPoints - 3 * nSegments;
+     auto offset = [&](hpuint k) { return k * (nSegments + 1) - k * (k - 1) / 2; };
+
+     //NOTE: The points are the corners, then the points in the interiors of the edges, and then the points in the interiors of the patches.  Corners are identified by their spherical coordinates and edges by their corners; the points on an edge run from its corner with the smaller index to the other one.  Every point is written by one patch, its owner.
+     std::map<std::pair<hpreal, hpreal>, hpuint> cornerIndices;
+     std::map<std::pair<hpuint, hpuint>, hpuint> edgeIndices;
+     std::vector<std::array<hpuint, 3> > corners(nPatches);
+     std::vector<std::array<hpuint, 3> > edges(nPatches);
+     std::vector<std::array<bool, 6> > owners(nPatches);
+     hpuint nCorners = 0, nEdges = 0;
+     for(hpuint p = 0; p < nPatches; ++p) {
+          auto parameters = surfaces[p].getParameterTriangle();
+          Point2D abscissae[3] = { std::get<0>(parameters), std::get<1>(parameters), std::get<2>(parameters) };
+          for(hpuint i = 0; i < 3; ++i) {
+               auto result = cornerIndices.emplace(std::make_pair(abscissae[i].x, abscissae[i].y), nCorners);
+               if(result.second) ++nCorners;
+               corners[p][i] = result.first->second;
+               owners[p][i] = result.second;
+          }
+          for(hpuint i = 0; i < 3; ++i) {
+               auto result = edgeIndices.emplace(std::minmax(corners[p][i], corners[p][(i + 1) % 3]), nEdges);
+               if(result.second) ++nEdges;
+               edges[p][i] = result.first->second;
+               owners[p][3 + i] = result.second;
+          }
+     }
+     auto nPoints = nCorners + nEdges * (nSegments - 1) + nPatches * nInteriorPoints;
+     auto interiors = nCorners + nEdges * (nSegments - 1);
+
+     std::vector<Vertex> vertices(nPoints);
+     std::vector<hpuint> indices(6 * nPatches * SurfaceUtilsBEZ::getNumberOfControlPolygonTriangles(nSegments) / 2);
+     cilk_for(hpuint p = 0; p < nPatches; ++p) {
+          auto& surface = surfaces[p];
+          auto& controlPoints = surface.getControlPoints();
+          auto& c = surface.getCorners();
+          std::vector<hpuint> map(nPatchPoints);
+
+          //NOTE: The ith edge runs from the ith corner to the (i+1)th corner; t counts the segments from the ith corner.
+          auto edge = [&](hpuint i, hpuint t) {
+               auto e = edges[p][i];
+               auto forward = corners[p][i] < corners[p][(i + 1) % 3];
+               return nCorners + e * (nSegments - 1) + (forward ? t : nSegments - t) - 1;
+          };
+
+          auto row = matrix.data();
+          hpuint s = 0, interior = interiors + p * nInteriorPoints;
+          for(hpuint k = 0; k <= nSegments; ++k) for(hpuint j = 0; j + k <= nSegments; ++j, ++s, row += nControlPoints) {
+               hpuint index;
+               bool owner;
+               if(j == 0 && k == 0) std::tie(index, owner) = std::make_tuple(corners[p][0], owners[p][0]);
+               else if(j == nSegments) std::tie(index, owner) = std::make_tuple(corners[p][1], owners[p][1]);
+               else if(k == nSegments) std::tie(index, owner) = std::make_tuple(corners[p][2], owners[p][2]);
+               else if(k == 0) std::tie(index, owner) = std::make_tuple(edge(0, j), owners[p][3]);
+               else if(j + k == nSegments) std::tie(index, owner) = std::make_tuple(edge(1, k), owners[p][4]);
+               else if(j == 0) std::tie(index, owner) = std::make_tuple(edge(2, nSegments - k), owners[p][5]);
+               else std::tie(index, owner) = std::make_tuple(interior++, true);
+               map[s] = index;
+               if(!owner) continue;
+
+               auto w = hpreal(k) / nSegments, v = hpreal(j) / nSegments, u = hpreal(1.0) - v - w;
+               auto x = u * c[0] + v * c[1] + w * c[2];
+               auto length = glm::length(x);
+               auto ordinate = row[0] * controlPoints[0];
+               for(hpuint i = 1; i < nControlPoints; ++i) ordinate += row[i] * controlPoints[i];
+               ordinate *= MathUtils::pow(hpreal(1.0) / length, degree);
+               vertices[index] = make_spherical_vertex<Vertex>(x / length, ordinate, factory);
+          }
+
+          auto triangle = indices.begin() + p * 3 * SurfaceUtilsBEZ::getNumberOfControlPolygonTriangles(nSegments);
+          for(hpuint k = 0; k < nSegments; ++k) {
+               auto bottom = offset(k), top = offset(k + 1);
+               for(hpuint j = 0; j + k < nSegments; ++j) {
+                    *(triangle++) = map[bottom + j];
+                    *(triangle++) = map[bottom + j + 1];
+                    *(triangle++) = map[top + j];
+                    if(j + k + 1 == nSegments) continue;
+                    *(triangle++) = map[bottom + j + 1];
+                    *(triangle++) = map[top + j + 1];
+                    *(triangle++) = map[top + j];
+               }
+          }
+     }
+
+     return make_triangle_mesh<Vertex>(std::move(vertices), std::move(indices));
+}
+
+template<hpuint degree, class Vertex = VertexP<Space3D>, class VertexFactory = happah::VertexFactory<Vertex>, typename = typename std::enable_if<(degree > 0)>::type>
+TriangleMesh<Vertex> make_triangle_mesh(const SurfaceSBB<Space1D, degree>& surface, hpuint nSamples, VertexFactory&& factory = VertexFactory()) { return make_triangle_mesh<degree, Vertex>(std::vector<SurfaceSBB<Space1D, degree> >(1, surface), nSamples, std::forward<VertexFactory>(factory)); }
+
+}//namespace happah
+
@@ -5,14 +5,22 @@
 
 #pragma once
 
+#include <algorithm>
 #include <boost/dynamic_bitset.hpp>
+#include <boost/optional.hpp>
+#include <cilk/cilk.h>
+#include <cmath>
+#include <limits>
 #include <type_traits>
 #include <vector>
 
+#include "happah/Eigen.h"
 #include "happah/Happah.h"
+#include "happah/geometries/Ray.h"
 #include "happah/geometries/Surface.h"
 #include "happah/geometries/TriangleMesh.h"
 #include "happah/geometries/TriangleMeshUtils.h"
+#include "happah/utils/BoundingVolumeHierarchy.h"
 #include "happah/utils/DeindexedArray.h"
 #include "happah/utils/SurfaceSubdividerBEZ.h"
 #include "happah/utils/SurfaceSplineUtilsBEZ.h"
@@ -21,41 +29,52 @@
 
 namespace happah {
 
-template<class Space, hpuint t_degree>
+//NOTE: The index type decides how many control points a spline can have.
+template<class Space, hpuint t_degree, class Index = hpuint>
 class SurfaceSplineBEZ : public Surface<Space> {
      using Point = typename Space::POINT;
      using ControlPoints = std::vector<Point>;
 
 public:
+     using INDEX = Index;
+     using Indices = std::vector<Index>;
+
      SurfaceSplineBEZ() {}
 
      SurfaceSplineBEZ(ControlPoints controlPoints, Indices indices)
           : m_controlPoints{std::move(controlPoints)}, m_indices{std::move(indices)} {}
 
      SurfaceSplineBEZ(ControlPoints controlPoints)
-          : m_controlPoints{std::move(controlPoints)}, m_indices{m_controlPoints.size()} { std::iota(std::begin(m_indices), std::end(m_indices), 0); }
+          : m_controlPoints(std::move(controlPoints)), m_indices(m_controlPoints.size()) { std::iota(std::begin(m_indices), std::end(m_indices), 0); }
 
      const ControlPoints& getControlPoints() const { return m_controlPoints; }
 
+     //NOTE: The neighbors are only available if they have been set explicitly, for example, by calling setNeighbors(make_neighbors(surface)).
+     const boost::optional<Indices>& getNeighbors() const { return m_neighbors; }
+
      hpuint getNumberOfPatches() const { return m_indices.size() / SurfaceUtilsBEZ::get_number_of_control_points<t_degree>::value; }
 
      std::tuple<const ControlPoints&, const Indices&> getPatches() const { return std::tie(m_controlPoints, m_indices); }
 
+     void setNeighbors(Indices neighbors) { m_neighbors = std::move(neighbors); }
+
 private:
      ControlPoints m_controlPoints;
      Indices m_indices;
+     boost::optional<Indices> m_neighbors;
 
      template<class Stream>
-     friend Stream& operator<<(Stream& stream, const SurfaceSplineBEZ<Space, t_degree>& surface) {
+     friend Stream& operator<<(Stream& stream, const SurfaceSplineBEZ<Space, t_degree, Index>& surface) {
           stream << surface.m_controlPoints << '\n';
           stream << surface.m_indices;
           return stream;
      }
 
      template<class Stream>
-     friend Stream& operator>>(Stream& stream, SurfaceSplineBEZ<Space, t_degree>& surface) {
+     friend Stream& operator>>(Stream& stream, SurfaceSplineBEZ<Space, t_degree, Index>& surface) {
           stream >> surface.m_controlPoints;
           stream >> surface.m_indices;
+          surface.m_neighbors = boost::none;
           return stream;
      }
 
@@ -83,10 +102,10 @@ void visit_corners(Iterator begin, Visitor&& visit) {
      visit(*begin, *(begin + degree), *(begin + (nControlPoints - 1)));
 }
 
-template<class Space, hpuint degree, class Visitor>
-void visit_fans(const SurfaceSplineBEZ<Space, degree>& surface, Visitor&& visit) {
-     auto neighbors = make_neighbors(surface);
-     visit_fans(neighbors, std::forward<Visitor>(visit));
+template<class Space, hpuint degree, class Index, class Visitor>
+void visit_fans(const SurfaceSplineBEZ<Space, degree, Index>& surface, Visitor&& visit) {
+     if(auto& neighbors = surface.getNeighbors()) visit_fans(*neighbors, std::forward<Visitor>(visit));
+     else visit_fans(make_neighbors(surface), std::forward<Visitor>(visit));
 }
 
 template<hpuint degree, class Iterator, class Visitor>
@@ -101,112 +120,481 @@ void visit_patches(Iterator begin, Iterator end, Visitor&& visit) {
      for(auto i = begin; i != end; i += nControlPoints) visit(i, i + nControlPoints);
 }
 
-template<class Space, hpuint degree, class Visitor>
-void visit_patches(const SurfaceSplineBEZ<Space, degree>& surface, Visitor&& visit) {
+template<class Space, hpuint degree, class Index, class Visitor>
+void visit_patches(const SurfaceSplineBEZ<Space, degree, Index>& surface, Visitor&& visit) {
      auto patches = surface.getPatches();
      auto temp = deindex(std::get<0>(patches), std::get<1>(patches));
      visit_patches<degree>(temp.begin(), temp.end(), std::forward<Visitor>(visit));
 }
 
-template<class Space, hpuint degree, class Visitor>
-void visit_ring(const SurfaceSplineBEZ<Space, degree>& surface, const Indices& neighbors, hpuint p, hpuint i, Visitor&& visit) {
+template<class Space, hpuint degree, class Index, class Visitor>
+void visit_ring(const SurfaceSplineBEZ<Space, degree, Index>& surface, const std::vector<Index>& neighbors, hpuint p, hpuint i, Visitor&& visit) {
      using Point = typename Space::POINT;
 
      std::vector<Point> ring;
-     auto& patches = surface.getPatches();
+     auto patches = surface.getPatches();
      auto& points = std::get<0>(patches);
      auto& indices = std::get<1>(patches);
 
      auto dir = i;
 
-     visit_fan(neighbors, p, i, [&](hpuint f) {
+     visit_fan(neighbors, p, i, [&](Index f) {
                //TODO: SM get control points at respective corner
-               hpuint next;
+               Index next;
 
-               visit_triplet(neighbors, f, [&](hpuint n0, hpuint n1, hpuint n2) { next = (dir == 0) ? n2 : (dir == 1) ? n0 : n1; });
+               visit_triplet(neighbors, f, [&](Index n0, Index n1, Index n2) { next = (dir == 0) ? n2 : (dir == 1) ? n0 : n1; });
                auto rightmost = (dir + 1) % 3;
 
                auto idx = *(indices.begin() + (3 * f + rightmost));
                auto& point = *(points.begin() + idx);
                ring.push_back(point);
 
-               visit_triplet(neighbors, next, [&](hpuint n0, hpuint n1, hpuint n2) { dir = (n0 == f) ? 0 : (n1 == f) ? 1 : 2; });
+               visit_triplet(neighbors, next, [&](Index n0, Index n1, Index n2) { dir = (n0 == f) ? 0 : (n1 == f) ? 1 : 2; });
      });
      visit(ring);
 }
 
-template<class Space, hpuint degree, class Visitor>
-void visit_ring(const SurfaceSplineBEZ<Space, degree>& surface, hpuint p, hpuint i, Visitor&& visit) {
-     auto neighbors = make_neighbors(surface);
-     visit_ring(surface, neighbors, p, i, std::forward<Visitor>(visit));
+template<class Space, hpuint degree, class Index, class Visitor>
+void visit_ring(const SurfaceSplineBEZ<Space, degree, Index>& surface, hpuint p, hpuint i, Visitor&& visit) {
+     if(auto& neighbors = surface.getNeighbors()) visit_ring(surface, *neighbors, p, i, std::forward<Visitor>(visit));
+     else visit_ring(surface, make_neighbors(surface), p, i, std::forward<Visitor>(visit));
 }
 
-template<class Space, hpuint degree, class Visitor>
-void visit_edges(const SurfaceSplineBEZ<Space, degree>& surface, Visitor&& visit) {
+template<class Space, hpuint degree, class Index, class Visitor>
+void visit_edges(const SurfaceSplineBEZ<Space, degree, Index>& surface, Visitor&& visit) {
      //TODO SM
-     auto neighbors = make_neighbors(surface);
-     visit_edges(neighbors, std::forward<Visitor>(visit));
+     if(auto& neighbors = surface.getNeighbors()) visit_edges(*neighbors, std::forward<Visitor>(visit));
+     else visit_edges(make_neighbors(surface), std::forward<Visitor>(visit));
 }
 
 //algorithms
 
-template<hpuint n, class Space, hpuint degree>
-SurfaceSplineBEZ<Space, (degree + n)> elevate(const SurfaceSplineBEZ<Space, degree>& surface) {
-     //TODO: TR specialize for n = 1
-     if(n == 1) {
-     } else {
+/**
+ * Elevate every patch from degree degree to degree degree + n; the surface does not change.  The patches are elevated in parallel with the coefficients in SurfaceUtilsBEZ::ElevationMatrix.  The elevated control points on an edge only depend on the control points on the edge, so patches that share a corner or all the control points on an edge share the elevated control points there too.  If the neighbors of the surface are set, they are also set on the elevated surface.
+ */
+template<hpuint n, class Space, hpuint degree, class Index>
+SurfaceSplineBEZ<Space, (degree + n), Index> elevate(const SurfaceSplineBEZ<Space, degree, Index>& surface) {
+     using Point = typename Space::POINT;
+     static constexpr hpuint nControlPoints = SurfaceUtilsBEZ::get_number_of_control_points<degree>::value;
+     static constexpr hpuint nElevatedControlPoints = SurfaceUtilsBEZ::get_number_of_control_points<degree + n>::value;
+     static constexpr hpuint nInteriorPoints = nElevatedControlPoints - 3 * (degree + n);
 
+     auto patches = surface.getPatches();
+     auto& indices = std::get<1>(patches);
+     auto controlPoints = deindex(std::get<0>(patches), indices).begin();
+     hpuint nPatches = surface.getNumberOfPatches();
+
+     Indices partners;
+     std::vector<char> reversed;
+     std::tie(partners, reversed) = make_partners(surface);
+     auto corner = [&](hpuint p, hpuint i) { return indices[p * nControlPoints + ((i == 0) ? 0 : (i == 1) ? degree : nControlPoints - 1)]; };
+
+     //NOTE: The points are the corners, then the points in the interiors of the edges, and then the points in the interiors of the patches.  Every point is written by one patch, its owner.
+     Indices corners(std::get<0>(patches).size(), UNULL), owners(std::get<0>(patches).size());
+     hpuint nPoints = 0;
+     for(hpuint p = 0; p < nPatches; ++p) for(hpuint i = 0; i < 3; ++i) {
+          auto c = corner(p, i);
+          if(corners[c] != UNULL) continue;
+          corners[c] = nPoints++;
+          owners[c] = p;
+     }
+     auto owns = [&](hpuint e) { return partners[e] == UNULL || e < partners[e]; };
+     Indices edges(3 * nPatches);
+     for(hpuint e = 0; e < 3 * nPatches; ++e) if(owns(e)) {
+          edges[e] = nPoints;
+          nPoints += degree + n - 1;
      }
-     return {};
+     for(hpuint e = 0; e < 3 * nPatches; ++e) if(!owns(e)) edges[e] = edges[partners[e]];
+     auto interiors = nPoints;
+     nPoints += nPatches * nInteriorPoints;
+
+     std::vector<Point> points(nPoints);
+     std::vector<Index> elevatedIndices(nPatches * nElevatedControlPoints);
+     cilk_for(hpuint p = 0; p < nPatches; ++p) {
+          Point elevated[nElevatedControlPoints];
+          SurfaceUtilsBEZ::template elevate<Space, degree, n>(controlPoints + p * nControlPoints, elevated);
+
+          //NOTE: The tth point on the ith edge is (i, t), so the ith corner is (i, 0).
+          auto index = elevatedIndices.begin() + p * nElevatedControlPoints;
+          auto interior = interiors + p * nInteriorPoints;
+          hpuint r = 0;
+          for(hpuint k = 0; k <= degree + n; ++k) for(hpuint j = 0; j + k <= degree + n; ++j, ++r) {
+               auto i = (j + k == degree + n && k != degree + n) ? 1 : (k == 0 && j != degree + n) ? 0 : (j == 0) ? 2 : 3;
+               auto t = (i == 0) ? j : (i == 1) ? k : degree + n - k;
+               auto e = 3 * p + i;
+               auto owner = (i == 3) ? true : (t == 0) ? owners[corner(p, i)] == p : owns(e);
+               auto point = (i == 3) ? interior++ : (t == 0) ? corners[corner(p, i)] : edges[e] + ((!owns(e) && reversed[e]) ? degree + n - 1 - t : t - 1);
+               *(index++) = Index(point);
+               if(owner) points[point] = elevated[r];
+          }
+     }
+
+     SurfaceSplineBEZ<Space, (degree + n), Index> elevatedSurface(std::move(points), std::move(elevatedIndices));
+     if(auto& neighbors = surface.getNeighbors()) elevatedSurface.setNeighbors(*neighbors);
+     return elevatedSurface;
 }
 
-template<class Space, hpuint degree>
-std::vector<hpuint> make_neighbors(const SurfaceSplineBEZ<Space, degree>& surface) {
-     Indices indices;
-     visit_patches<degree>(std::get<1>(surface.getPatches()).begin(), surface.getNumberOfPatches(), [&](auto begin, auto end) {
-          visit_corners<degree>(begin, [&](hpuint i0, hpuint i1, hpuint i2) {
-               indices.push_back(i0);
-               indices.push_back(i1);
-               indices.push_back(i2);
+//NOTE: Evaluates the patches[i]th patch at (us[i], vs[i]) for every i.  Use this instead of evaluating one point at a time when there are many queries; see SurfaceUtilsBEZ::evaluate.
+template<class Space, hpuint degree, class Index>
+std::vector<typename Space::POINT> evaluate(const SurfaceSplineBEZ<Space, degree, Index>& surface, const std::vector<hpuint>& patches, const std::vector<hpreal>& us, const std::vector<hpreal>& vs) {
+     assert(us.size() == patches.size() && vs.size() == patches.size());
+     auto controlPoints = deindex(surface.getControlPoints(), std::get<1>(surface.getPatches()));
+     std::vector<typename Space::POINT> points(patches.size());
+     SurfaceUtilsBEZ::template evaluate<Space, degree>(controlPoints.begin(), patches.data(), us.data(), vs.data(), patches.size(), points.data());
+     return points;
+}
+
+/**
+ * Intersect the rays with the spline.  The hierarchy, built by make_bounding_volume_hierarchy, culls the subpatches whose boxes a ray misses.  For every other subpatch, Newton's method, started at the center of the subpatch, solves for the parameters at which the patch meets two planes whose intersection is the ray.  From the center of a large subpatch, Newton's method may converge to a farther intersection or not at all, so the hierarchy should be built with a few subdivisions.  The rays are intersected in parallel.
+ * @param[epsilon] Relative tolerance; a point is on a ray if its distance from the ray is less than epsilon times one plus its distance from the origin of the ray.
+ * @return For every ray, the patch, the parameters u and v, and the ray parameter t of the nearest intersection with t >= 0, if there is one.
+ */
+template<hpuint degree, class Index>
+std::vector<boost::optional<std::tuple<hpuint, hpreal, hpreal, hpreal> > > intersect(const SurfaceSplineBEZ<Space3D, degree, Index>& surface, const BoundingVolumeHierarchy& hierarchy, const std::vector<Ray3D>& rays, hpreal epsilon = EPSILON) {
+     static constexpr hpuint nControlPoints = SurfaceUtilsBEZ::get_number_of_control_points<degree>::value;
+     static constexpr hpuint nIterations = 16;
+
+     auto nSubpatches = hierarchy.getNumberOfItems() / surface.getNumberOfPatches();
+     hpuint nSubdivisions = 0;
+     while((1u << (nSubdivisions << 1)) < nSubpatches) ++nSubdivisions;
+     assert(hierarchy.getNumberOfItems() == surface.getNumberOfPatches() << (nSubdivisions << 1));
+
+     auto centers = SurfaceSubdividerBEZ<Space3D, degree>::getCenters(nSubdivisions);
+     auto controlPoints = deindex(surface.getControlPoints(), std::get<1>(surface.getPatches())).begin();
+     std::vector<boost::optional<std::tuple<hpuint, hpreal, hpreal, hpreal> > > intersections(rays.size());
+     cilk_for(hpuint r = 0; r < rays.size(); ++r) {
+          auto& origin = rays[r].getOrigin();
+          auto& direction = rays[r].getDirection();
+          auto normal0 = glm::normalize((std::abs(direction.x) > std::abs(direction.y) && std::abs(direction.x) > std::abs(direction.z)) ? Vector3D(direction.y, -direction.x, 0.0) : Vector3D(0.0, direction.z, -direction.y));
+          auto normal1 = glm::normalize(glm::cross(direction, normal0));
+          auto length2 = glm::dot(direction, direction);
+          auto& intersection = intersections[r];
+
+          hierarchy.visit(rays[r], std::numeric_limits<hpreal>::infinity(), [&](hpuint item) -> hpreal {
+               auto best = (intersection) ? std::get<3>(*intersection) : std::numeric_limits<hpreal>::infinity();
+               auto p = item / nSubpatches;
+               auto patch = controlPoints + p * nControlPoints;
+               std::array<Point3D, nControlPoints> local;//NOTE: The patch relative to the origin of the ray, so that offsets are not rounded to the size of the coordinates.
+               std::transform(patch, patch + nControlPoints, local.begin(), [&](const Point3D& point) { return point - origin; });
+               auto u = centers[item % nSubpatches].x, v = centers[item % nSubpatches].y;
+               auto close = false;
+               for(hpuint i = 0; i <= nIterations; ++i) {
+                    Point3D offset;
+                    Vector3D partialU, partialV;
+                    std::tie(offset, partialU, partialV) = SurfaceUtilsBEZ::template evaluateWithPartials<Space3D, degree>(u, v, 1.0 - u - v, local.begin());
+                    auto f0 = glm::dot(normal0, offset), f1 = glm::dot(normal1, offset);
+                    auto residual2 = f0 * f0 + f1 * f1;
+                    //NOTE: The rounding error in the residual grows with the distance from the origin of the ray, so the tolerance does too; once the residual is within it, one more step is taken so that the accepted point is no coarser than the tolerance allows.
+                    auto tolerance = epsilon * (hpreal(1.0) + glm::length(offset));
+                    if(residual2 < tolerance * tolerance) {
+                         if(close || residual2 < epsilon * epsilon) {
+                              auto t = glm::dot(offset, direction) / length2;
+                              if(t >= 0 && t < best && u >= -epsilon && v >= -epsilon && u + v <= 1.0 + epsilon) {
+                                   intersection = std::make_tuple(p, u, v, t);
+                                   return t;
+                              }
+                              break;
+                         }
+                         close = true;
+                    }
+                    auto a = glm::dot(normal0, partialU), b = glm::dot(normal0, partialV), c = glm::dot(normal1, partialU), d = glm::dot(normal1, partialV);
+                    auto determinant = a * d - b * c;
+                    if(determinant == 0) break;
+                    u -= (d * f0 - b * f1) / determinant;
+                    v -= (a * f1 - c * f0) / determinant;
+                    if(u < -1.0 || v < -1.0 || u + v > 2.0) break;//NOTE: Newton's method is diverging.
+               }
+               return best;
           });
-     });
-     return make_neighbors(indices);
+     }
+     return intersections;
 }
 
-template<class Space, hpuint degree>
-SurfaceSplineBEZ<Space, degree> subdivide(const SurfaceSplineBEZ<Space, degree>& surface, hpuint nSubdivisions) {
-     using Point = typename Space::POINT;
+template<hpuint degree, class Index>
+boost::optional<std::tuple<hpuint, hpreal, hpreal, hpreal> > intersect(const SurfaceSplineBEZ<Space3D, degree, Index>& surface, const BoundingVolumeHierarchy& hierarchy, const Ray3D& ray, hpreal epsilon = EPSILON) { return intersect(surface, hierarchy, std::vector<Ray3D>(1, ray), epsilon)[0]; }
+
+/**
+ * Bound the patches, each subdivided nSubdivisions times, by the boxes of their control points, which contain them; the (4^nSubdivisions * p + s)th item of the hierarchy is the sth subpatch of the pth patch.  More subdivisions give tighter boxes and better starting points for intersect and project but more items.
+ */
+template<hpuint degree, class Index>
+BoundingVolumeHierarchy make_bounding_volume_hierarchy(const SurfaceSplineBEZ<Space3D, degree, Index>& surface, hpuint nSubdivisions = 2) {
      static constexpr hpuint nControlPoints = SurfaceUtilsBEZ::get_number_of_control_points<degree>::value;
-     static constexpr hpuint nTriangles = SurfaceUtilsBEZ::get_number_of_control_polygon_triangles<degree>::value;
 
-     if(nSubdivisions == 0) return surface;
+     auto subdivided = subdivide(surface, nSubdivisions);
+     auto& points = std::get<0>(subdivided.getPatches());
+     auto& indices = std::get<1>(subdivided.getPatches());
+     auto nPatches = subdivided.getNumberOfPatches();
+     std::vector<Point3D> mins(nPatches), maxs(nPatches);
+     cilk_for(hpuint p = 0; p < nPatches; ++p) {
+          auto i = indices.begin() + p * nControlPoints;
+          auto min = points[*i], max = min;
+          for(auto end = i + nControlPoints; ++i != end; ) {
+               min = glm::min(min, points[*i]);
+               max = glm::max(max, points[*i]);
+          }
+          mins[p] = min;
+          maxs[p] = max;
+     }
+     return { mins, maxs };
+}
 
+template<class Space, hpuint degree, class Index>
+std::vector<Index> make_neighbors(const SurfaceSplineBEZ<Space, degree, Index>& surface) {
+     static constexpr hpuint nControlPoints = SurfaceUtilsBEZ::get_number_of_control_points<degree>::value;
      auto nPatches = surface.getNumberOfPatches();
+     auto patches = std::get<1>(surface.getPatches()).begin();
+     std::vector<Index> indices(3 * nPatches);
+     cilk_for(hpuint p = 0; p < nPatches; ++p) {
+          visit_corners<degree>(patches + p * nControlPoints, [&](Index i0, Index i1, Index i2) {
+               indices[3 * p] = i0;
+               indices[3 * p + 1] = i1;
+               indices[3 * p + 2] = i2;
+          });
+     }
+     return make_neighbors(indices);
+}
+
+/**
+ * The ith edge of a patch runs from its ith to its (i+1)th corner.  The partner of an edge is the same edge seen from the neighboring patch if the two patches share all the control points on the edge.
+ * @return Index of the partner of every edge, 3 * patch + edge, or UNULL if the edge has none, and whether the partner traverses the edge in the opposite direction.
+ */
+template<class Space, hpuint degree, class Index>
+std::tuple<Indices, std::vector<char> > make_partners(const SurfaceSplineBEZ<Space, degree, Index>& surface) {
+     static constexpr hpuint nControlPoints = SurfaceUtilsBEZ::get_number_of_control_points<degree>::value;
+
+     auto& indices = std::get<1>(surface.getPatches());
+     hpuint nPatches = surface.getNumberOfPatches();
+     auto offset = [&](hpuint k) { return k * (degree + 1) - k * (k - 1) / 2; };
+     auto edge_index = [&](hpuint p, hpuint i, hpuint t) -> Index { return indices[p * nControlPoints + ((i == 0) ? t : (i == 1) ? offset(t) + degree - t : offset(degree - t))]; };
+
+     std::vector<Index> temp;
+     if(!surface.getNeighbors()) temp = make_neighbors(surface);
+     auto& neighbors = (surface.getNeighbors()) ? *surface.getNeighbors() : temp;
+
+     Indices partners(3 * nPatches, UNULL);
+     std::vector<char> reversed(3 * nPatches, false);
+     cilk_for(hpuint e = 0; e < 3 * nPatches; ++e) {
+          auto p = e / 3, i = e % 3;
+          auto q = neighbors[e];
+          if(q == INULL<Index>) continue;
+          for(hpuint j = 0; j < 3; ++j) {
+               if(neighbors[3 * q + j] != p) continue;
+               auto same = true, opposite = true;
+               for(hpuint t = 0; t <= degree; ++t) {
+                    same = same && edge_index(p, i, t) == edge_index(q, j, t);
+                    opposite = opposite && edge_index(p, i, t) == edge_index(q, j, degree - t);
+               }
+               if(same || opposite) {
+                    partners[e] = 3 * q + j;
+                    reversed[e] = opposite;
+                    break;
+               }
+          }
+     }
+     return std::make_tuple(std::move(partners), std::move(reversed));
+}
+
+/**
+ * Project the points onto the spline.  The hierarchy, built by make_bounding_volume_hierarchy, visits the subpatches best first, leaf by leaf in the order of the distances of the boxes of the leaves, and stops at the first box that is farther away than the nearest point found so far.  For every other subpatch, Gauss-Newton steps in the barycentric coordinates (u, v, 1 - u - v), started at the center of the subpatch, kept inside the parameter triangle, and shortened until the distance decreases, minimize the distance to the patch.  The points are projected in parallel.
+ * @return For every point, the patch, the parameters u and v, and the distance of the nearest point on the spline.
+ */
+template<hpuint degree, class Index>
+std::vector<std::tuple<hpuint, hpreal, hpreal, hpreal> > project(const SurfaceSplineBEZ<Space3D, degree, Index>& surface, const BoundingVolumeHierarchy& hierarchy, const std::vector<Point3D>& points, hpreal epsilon = EPSILON) {
+     static constexpr hpuint nControlPoints = SurfaceUtilsBEZ::get_number_of_control_points<degree>::value;
+     static constexpr hpuint nIterations = 32;
+
+     auto nSubpatches = hierarchy.getNumberOfItems() / surface.getNumberOfPatches();
+     hpuint nSubdivisions = 0;
+     while((1u << (nSubdivisions << 1)) < nSubpatches) ++nSubdivisions;
+     assert(hierarchy.getNumberOfItems() == surface.getNumberOfPatches() << (nSubdivisions << 1));
+
+     auto centers = SurfaceSubdividerBEZ<Space3D, degree>::getCenters(nSubdivisions);
+     auto controlPoints = deindex(surface.getControlPoints(), std::get<1>(surface.getPatches())).begin();
+     std::vector<std::tuple<hpuint, hpreal, hpreal, hpreal> > projections(points.size());
+     cilk_for(hpuint i = 0; i < points.size(); ++i) {
+          auto& point = points[i];
+          auto& projection = projections[i];
+          projection = std::make_tuple(UNULL, 0.0, 0.0, std::numeric_limits<hpreal>::infinity());//NOTE: The distance is squared until all subpatches have been visited.
+
+          hierarchy.visit(point, std::numeric_limits<hpreal>::infinity(), [&](hpuint item) -> hpreal {
+               auto p = item / nSubpatches;
+               auto patch = controlPoints + p * nControlPoints;
+               auto u = centers[item % nSubpatches].x, v = centers[item % nSubpatches].y;
+               auto evaluate = [&](hpreal u, hpreal v) { return SurfaceUtilsBEZ::template evaluateWithPartials<Space3D, degree>(u, v, 1.0 - u - v, patch); };
+               auto distance2 = [&](const std::tuple<Point3D, Vector3D, Vector3D>& evaluation) { auto offset = std::get<0>(evaluation) - point; return glm::dot(offset, offset); };
+
+               auto evaluation = evaluate(u, v);
+               auto best = distance2(evaluation);
+               for(hpuint j = 0; j < nIterations; ++j) {
+                    auto& partialU = std::get<1>(evaluation);
+                    auto& partialV = std::get<2>(evaluation);
+                    auto offset = std::get<0>(evaluation) - point;
+                    auto a = glm::dot(partialU, partialU), b = glm::dot(partialU, partialV), c = glm::dot(partialV, partialV);
+                    auto determinant = a * c - b * b;
+                    if(determinant <= 0) break;
+                    auto gu = glm::dot(partialU, offset), gv = glm::dot(partialV, offset);
+                    auto stepU = (c * gu - b * gv) / determinant, stepV = (a * gv - b * gu) / determinant;
+
+                    //NOTE: On an edge of the parameter triangle, a step that leaves the triangle is replaced by a step along the edge, where the nearest point may lie if the spline is not smooth.
+                    auto slide = [&](hpreal eu, hpreal ev) {
+                         auto step = (gu * eu + gv * ev) / (a * eu * eu + 2 * b * eu * ev + c * ev * ev);
+                         stepU = step * eu;
+                         stepV = step * ev;
+                    };
+                    if(u < epsilon && stepU > 0) slide(0.0, 1.0);
+                    else if(v < epsilon && stepV > 0) slide(1.0, 0.0);
+                    else if(1.0 - u - v < epsilon && stepU + stepV < 0) slide(1.0, -1.0);
+
+                    //NOTE: The step is halved until the patch gets closer, so the iteration does not leave the basin of the nearest point.
+                    hpreal u1, v1, candidate2;
+                    std::tuple<Point3D, Vector3D, Vector3D> candidate;
+                    auto lambda = hpreal(1.0);
+                    do {
+                         u1 = u - lambda * stepU;
+                         v1 = v - lambda * stepV;
+                         hpreal w1 = 1.0 - u1 - v1;
+                         if(u1 < 0 || v1 < 0 || w1 < 0) {
+                              u1 = std::max(u1, hpreal(0.0));
+                              v1 = std::max(v1, hpreal(0.0));
+                              auto sum = u1 + v1 + std::max(w1, hpreal(0.0));
+                              u1 /= sum;
+                              v1 /= sum;
+                         }
+                         candidate = evaluate(u1, v1);
+                         candidate2 = distance2(candidate);
+                         lambda *= 0.5;
+                    } while(candidate2 > best && lambda > epsilon);
+                    if(candidate2 > best) break;
+
+                    auto change = std::abs(u1 - u) + std::abs(v1 - v);
+                    u = u1;
+                    v = v1;
+                    evaluation = candidate;
+                    best = candidate2;
+                    if(change < epsilon) break;
+               }
+               if(best < std::get<3>(projection)) projection = std::make_tuple(p, u, v, best);
+               return std::get<3>(projection);
+          });
+          std::get<3>(projection) = std::sqrt(std::get<3>(projection));
+     }
+     return projections;
+}
+
+template<hpuint degree, class Index>
+std::tuple<hpuint, hpreal, hpreal, hpreal> project(const SurfaceSplineBEZ<Space3D, degree, Index>& surface, const BoundingVolumeHierarchy& hierarchy, const Point3D& point, hpreal epsilon = EPSILON) { return project(surface, hierarchy, std::vector<Point3D>(1, point), epsilon)[0]; }
 
-     std::vector<SurfaceSubdividerBEZ<Space, degree> > subdividers;
-     subdividers.reserve(nPatches);
-     auto push_patch = [&](auto begin, auto end) { subdividers.emplace_back(begin); };
-     visit_patches(surface, push_patch);
+/**
+ * Subdivide every patch nSubdivisions times; every patch is split into 4^nSubdivisions patches.  The patches are subdivided in parallel, and, because every patch produces the same number of points and indices, each one writes straight into its own slice of the preallocated output.
+ * @param[weld] If true, the subdivided patches of neighboring patches share the control points on their common edge and at their common corners instead of each having a copy.  An edge is shared if the neighboring patches share all the control points on it; corners are shared if they are the same control point.  Otherwise, every subdivided patch only shares control points with the subdivided patches of the same patch.
+ */
+template<class Space, hpuint degree, class Index>
+SurfaceSplineBEZ<Space, degree, Index> subdivide(const SurfaceSplineBEZ<Space, degree, Index>& surface, hpuint nSubdivisions, bool weld = false) {
+     using Point = typename Space::POINT;
+     using Subdivider = SurfaceSubdividerBEZ<Space, degree>;
+     static constexpr hpuint nControlPoints = SurfaceUtilsBEZ::get_number_of_control_points<degree>::value;
+     static constexpr hpuint nPatchesPerBlock = 64;//NOTE: The patches in a block share one workspace.
 
-     std::vector<Point> points;
-     Indices indices;
+     if(nSubdivisions == 0) return surface;
 
-     points.reserve(nControlPoints * nPatches);
-     indices.reserve(3 * nTriangles * nPatches);
+     auto patches = surface.getPatches();
+     auto& indices = std::get<1>(patches);
+     auto controlPoints = deindex(std::get<0>(patches), indices).begin();
+     hpuint nPatches = surface.getNumberOfPatches();
+     hpuint nRows = 1 << nSubdivisions;
+     hpuint nSegments = nRows * degree;//NOTE: Number of segments into which the control points of a subdivided patch divide one of its edges.
+     auto nPatchPoints = Subdivider::getNumberOfPoints(nSubdivisions);
+     auto nPatchIndices = Subdivider::getNumberOfIndices(nSubdivisions);
+     auto& patchIndices = Subdivider::getCachedIndices(nSubdivisions);
+     auto nBlocks = (nPatches + nPatchesPerBlock - 1) / nPatchesPerBlock;
+
+     if(!weld) {
+          std::vector<Point> points(nPatches * nPatchPoints);
+          std::vector<Index> subindices(nPatches * nPatchIndices);
+          cilk_for(hpuint b = 0; b < nBlocks; ++b) {
+               std::vector<Point> workspace(Subdivider::getWorkspaceSize(nSubdivisions));
+               for(hpuint p = b * nPatchesPerBlock, end = std::min(p + nPatchesPerBlock, nPatches); p < end; ++p) {
+                    Subdivider subdivider(controlPoints + p * nControlPoints);
+                    auto offset = p * nPatchPoints;
+                    subdivider.subdivide(nSubdivisions, points.data() + offset, workspace.data());
+                    std::transform(std::begin(patchIndices), std::end(patchIndices), std::begin(subindices) + p * nPatchIndices, [&](hpuint i) { return Index(i + offset); });
+               }
+          }
+          return { std::move(points), std::move(subindices) };
+     }
 
-     for(auto& subdivider : subdividers) {
+     //NOTE: Subdividing the patch whose control points are the domain points scaled by the degree yields the domain point of every subdivided control point; scaled by the number of rows, the coordinates are integers, which tell whether the point is on an edge of the patch.  The ith edge runs from the ith to the (i+1)th corner, and the tth point on it is identified by (i, t), so the ith corner is (i, 0); interior points are (3, t), where t counts the interior points.
+     std::vector<std::pair<hpuint, hpuint> > positions;
+     positions.reserve(nPatchPoints);
+     {
+          std::vector<Point2D> domain;
+          domain.reserve(nControlPoints);
+          for(hpuint k = 0; k <= degree; ++k) for(hpuint j = 0; j + k <= degree; ++j) domain.emplace_back(j, k);
+          SurfaceSubdividerBEZ<Space2D, degree> subdivider(domain.begin());
           auto subdivided = subdivider.subdivide(nSubdivisions);
-          auto offset = points.size();
-          for(auto& i : std::get<0>(subdivided)) i += offset;
-          std::move(begin(std::get<0>(subdivided)), end(std::get<0>(subdivided)), std::back_inserter(points));
-          std::move(begin(std::get<1>(subdivided)), end(std::get<1>(subdivided)), std::back_inserter(indices));
+          hpuint nInteriorPoints = 0;
+          for(auto& point : std::get<0>(subdivided)) {
+               auto a = hpuint(std::lround(point.x * nRows)), b = hpuint(std::lround(point.y * nRows)), c = nSegments - a - b;
+               if(a == nSegments) positions.emplace_back(1, 0);
+               else if(b == nSegments) positions.emplace_back(2, 0);
+               else if(c == nSegments) positions.emplace_back(0, 0);
+               else if(b == 0) positions.emplace_back(0, a);
+               else if(c == 0) positions.emplace_back(1, b);
+               else if(a == 0) positions.emplace_back(2, c);
+               else positions.emplace_back(3, nInteriorPoints++);
+          }
+          assert(nInteriorPoints == nPatchPoints - 3 * nSegments);
+     }
+     auto nInteriorPoints = nPatchPoints - 3 * nSegments;
+
+     Indices partners;
+     std::vector<char> reversed;
+     std::tie(partners, reversed) = make_partners(surface);
+     auto corner = [&](hpuint p, hpuint i) { return indices[p * nControlPoints + ((i == 0) ? 0 : (i == 1) ? degree : nControlPoints - 1)]; };
+
+     //NOTE: The points are the corners, then the points in the interiors of the edges, and then the points in the interiors of the patches.  Every point is written by one patch, its owner.
+     Indices corners(std::get<0>(patches).size(), UNULL), owners(std::get<0>(patches).size());
+     hpuint nPoints = 0;
+     for(hpuint p = 0; p < nPatches; ++p) for(hpuint i = 0; i < 3; ++i) {
+          auto c = corner(p, i);
+          if(corners[c] != UNULL) continue;
+          corners[c] = nPoints++;
+          owners[c] = p;
+     }
+     auto owns = [&](hpuint e) { return partners[e] == UNULL || e < partners[e]; };
+     Indices edges(3 * nPatches);
+     for(hpuint e = 0; e < 3 * nPatches; ++e) if(owns(e)) {
+          edges[e] = nPoints;
+          nPoints += nSegments - 1;
+     }
+     for(hpuint e = 0; e < 3 * nPatches; ++e) if(!owns(e)) edges[e] = edges[partners[e]];
+     auto interiors = nPoints;
+     nPoints += nPatches * nInteriorPoints;
+
+     std::vector<Point> points(nPoints);
+     std::vector<Index> subindices(nPatches * nPatchIndices);
+     cilk_for(hpuint b = 0; b < nBlocks; ++b) {
+          std::vector<Point> subpoints(nPatchPoints), workspace(Subdivider::getWorkspaceSize(nSubdivisions));
+          std::vector<hpuint> map(nPatchPoints);
+          for(hpuint p = b * nPatchesPerBlock, end = std::min(p + nPatchesPerBlock, nPatches); p < end; ++p) {
+               Subdivider subdivider(controlPoints + p * nControlPoints);
+               subdivider.subdivide(nSubdivisions, subpoints.data(), workspace.data());
+               for(hpuint s = 0; s < nPatchPoints; ++s) {
+                    auto i = positions[s].first, t = positions[s].second;
+                    auto e = 3 * p + i;
+                    auto owner = (i == 3) ? true : (t == 0) ? owners[corner(p, i)] == p : owns(e);
+                    map[s] = (i == 3) ? interiors + p * nInteriorPoints + t : (t == 0) ? corners[corner(p, i)] : edges[e] + ((!owns(e) && reversed[e]) ? nSegments - 1 - t : t - 1);
+                    if(owner) points[map[s]] = subpoints[s];
+               }
+               std::transform(std::begin(patchIndices), std::end(patchIndices), std::begin(subindices) + p * nPatchIndices, [&](hpuint s) { return Index(map[s]); });
+          }
      }
 
-     return { std::move(points), std::move(indices) };
+     return { std::move(points), std::move(subindices) };
 }
 
-template<class Space, hpuint degree, class Vertex = VertexP<Space>, class VertexFactory = happah::VertexFactory<Vertex>, typename = typename std::enable_if<(degree > 0)>::type>
-TriangleMesh<Vertex> make_triangle_mesh(const SurfaceSplineBEZ<Space, degree>& surface, VertexFactory&& factory = VertexFactory()) {
+template<class Space, hpuint degree, class Vertex = VertexP<Space>, class VertexFactory = happah::VertexFactory<Vertex>, class Index, typename = typename std::enable_if<(degree > 0)>::type>
+TriangleMesh<Vertex, Format::SIMPLE, HeapStorage, Index> make_triangle_mesh(const SurfaceSplineBEZ<Space, degree, Index>& surface, VertexFactory&& factory = VertexFactory()) {
      using Point = typename Space::POINT;
      static_assert(std::is_base_of<Vertex, decltype(factory(Point(0.0)))>::value, "The vertex generated by the factory must be a subclass of the vertex with which the triangle mesh is parameterized.");
 
@@ -219,20 +607,20 @@ TriangleMesh<Vertex> make_triangle_mesh(const SurfaceSplineBEZ<Space, degree>& s
      return make_triangle_mesh(std::move(vertices), std::move(indices));
 }
 
-template<class Space, hpuint degree, class Vertex = VertexP<Space>, class VertexFactory = happah::VertexFactory<Vertex>, typename = typename std::enable_if<(degree > 0)>::type>
-TriangleMesh<Vertex> make_triangle_mesh(const SurfaceSplineBEZ<Space, degree>& surface, hpuint nSubdivisions, VertexFactory&& factory = VertexFactory()) {
+template<class Space, hpuint degree, class Vertex = VertexP<Space>, class VertexFactory = happah::VertexFactory<Vertex>, class Index, typename = typename std::enable_if<(degree > 0)>::type>
+TriangleMesh<Vertex, Format::SIMPLE, HeapStorage, Index> make_triangle_mesh(const SurfaceSplineBEZ<Space, degree, Index>& surface, hpuint nSubdivisions, VertexFactory&& factory = VertexFactory()) {
      if(nSubdivisions > 0) return make_triangle_mesh<Space, degree, Vertex, VertexFactory>(subdivide(surface, nSubdivisions), std::forward<VertexFactory>(factory));
      else return make_triangle_mesh<Space, degree, Vertex, VertexFactory>(surface, std::forward<VertexFactory>(factory));
 }
 
-template<class Space, hpuint degree, class Vertex = VertexP<Space>, class VertexFactory = happah::VertexFactory<Vertex> >
-TriangleMesh<Vertex> make_control_polygon(const SurfaceSplineBEZ<Space, degree>& surface, VertexFactory&& factory = VertexFactory()) { return make_triangle_mesh<Space, degree, Vertex, VertexFactory>(surface, std::forward<VertexFactory>(factory)); }
+template<class Space, hpuint degree, class Vertex = VertexP<Space>, class VertexFactory = happah::VertexFactory<Vertex>, class Index>
+TriangleMesh<Vertex, Format::SIMPLE, HeapStorage, Index> make_control_polygon(const SurfaceSplineBEZ<Space, degree, Index>& surface, VertexFactory&& factory = VertexFactory()) { return make_triangle_mesh<Space, degree, Vertex, VertexFactory>(surface, std::forward<VertexFactory>(factory)); }
 
 //TODO: move non-member functions with iterators into subnamespace so as not to conflict with implementations for curves, for example
 template<hpuint degree, class Iterator, class Visitor>
 void sample(Iterator begin, hpuint nPatches, hpuint nSamples, Visitor&& visit) {
-     //TODO; skip multiple computations on common edges and eliminate common points in array
-     auto matrix = SurfaceUtilsBEZ::getEvaluationMatrix<degree>(nSamples);
+     //NOTE: Samples on common edges are computed by both patches; see tessellate for a version that computes them once.
+     auto& matrix = SurfaceUtilsBEZ::getCachedEvaluationMatrix<degree>(nSamples);
      visit_patches<degree>(begin, nPatches, [&](auto begin, auto end) {
           for(auto m = matrix.begin(), mend = matrix.end(); m != mend; ++m) {
                auto temp = begin;
@@ -246,8 +634,8 @@ void sample(Iterator begin, hpuint nPatches, hpuint nSamples, Visitor&& visit) {
 template<hpuint degree, class ControlPointsIterator, class DomainPointsIterator, class Visitor>
 void sample(ControlPointsIterator controlPoints, DomainPointsIterator domainPoints, hpuint nPatches, hpuint nSamples, Visitor&& visit) {
      //TODO; skip multiple computations on common edges and eliminate common points in array
-     auto matrixd = SurfaceUtilsBEZ::getEvaluationMatrix<degree>(nSamples);
-     auto matrix1 = SurfaceUtilsBEZ::getEvaluationMatrix<1>(nSamples);
+     auto& matrixd = SurfaceUtilsBEZ::getCachedEvaluationMatrix<degree>(nSamples);
+     auto& matrix1 = SurfaceUtilsBEZ::getCachedEvaluationMatrix<1>(nSamples);
      visit_patches<degree>(controlPoints, nPatches, [&](auto begin, auto end) {
           auto& p0 = *domainPoints;
           auto& p1 = *(++domainPoints);
@@ -269,18 +657,270 @@ void sample(ControlPointsIterator controlPoints, DomainPointsIterator domainPoin
      });
 }
 
-template<class Space, hpuint degree, class Visitor>
-void sample(const SurfaceSplineBEZ<Space, degree>& surface, hpuint nSamples, Visitor&& visit) {
+template<class Space, hpuint degree, class Index, class Visitor>
+void sample(const SurfaceSplineBEZ<Space, degree, Index>& surface, hpuint nSamples, Visitor&& visit) {
      auto patches = surface.getPatches();
      sample<degree>(deindex(std::get<0>(patches), std::get<1>(patches)).begin(), surface.getNumberOfPatches(), nSamples, std::forward<Visitor>(visit));
 }
 
-template<class Space, hpuint degree, class T, class Visitor>
-void sample(const SurfaceSplineBEZ<Space, degree>& surface, std::tuple<const std::vector<T>&, const Indices&> domain, hpuint nSamples, Visitor&& visit) {
+//NOTE: Returns the samples of all patches, patch by patch, in the order in which the other sample functions visit them.  The samples are computed as one product of the evaluation matrix with the control points of many patches side by side, so that Eigen's matrix product does the work.
+template<class Space, hpuint degree, class Index>
+std::vector<typename Space::POINT> sample(const SurfaceSplineBEZ<Space, degree, Index>& surface, hpuint nSamples) {
+     using Matrix = Eigen::Matrix<hpreal, Eigen::Dynamic, Eigen::Dynamic>;
+     using EvaluationMatrix = Eigen::Matrix<hpreal, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+     static constexpr hpuint DIMENSION = Space::DIMENSION;
+     static constexpr hpuint nControlPoints = SurfaceUtilsBEZ::get_number_of_control_points<degree>::value;
+     static constexpr hpuint nPatchesPerProduct = 1024;//NOTE: Bounds the size of the temporary matrices; the products run in parallel.
+
+     auto& matrix = SurfaceUtilsBEZ::getCachedEvaluationMatrix<degree>(nSamples);
+     auto nPatches = surface.getNumberOfPatches();
+     auto nPoints = SurfaceUtilsBEZ::getNumberOfControlPoints(nSamples - 1);
+     auto& points = surface.getControlPoints();
+     auto& indices = std::get<1>(surface.getPatches());
+     Eigen::Map<const EvaluationMatrix> evaluation(matrix.data(), nPoints, nControlPoints);
+     std::vector<typename Space::POINT> samples(nPatches * nPoints);
+
+     auto nProducts = (nPatches + nPatchesPerProduct - 1) / nPatchesPerProduct;
+     cilk_for(hpuint product = 0; product < nProducts; ++product) {
+          auto begin = product * nPatchesPerProduct;
+          auto n = std::min(nPatches - begin, nPatchesPerProduct);
+          Matrix controlPoints(nControlPoints, DIMENSION * n);//NOTE: The column DIMENSION * p + c holds the cth coordinates of the control points of the pth patch.
+          for(hpuint p = 0; p < n; ++p) for(hpuint i = 0; i < nControlPoints; ++i) {
+               auto& point = points[indices[(begin + p) * nControlPoints + i]];
+               for(hpuint c = 0; c < DIMENSION; ++c) controlPoints(i, DIMENSION * p + c) = point[c];
+          }
+          Matrix result = evaluation * controlPoints;
+          auto sample = samples.begin() + begin * nPoints;
+          for(hpuint p = 0; p < n; ++p) for(hpuint i = 0; i < nPoints; ++i, ++sample) for(hpuint c = 0; c < DIMENSION; ++c) (*sample)[c] = result(i, DIMENSION * p + c);
+     }
+
+     return samples;
+}
+
+template<class Space, hpuint degree, class Index, class T, class Visitor>
+void sample(const SurfaceSplineBEZ<Space, degree, Index>& surface, std::tuple<const std::vector<T>&, const std::vector<Index>&> domain, hpuint nSamples, Visitor&& visit) {
      auto patches = surface.getPatches();
      auto controlPoints = deindex(std::get<0>(patches), std::get<1>(patches)).begin();
      auto domainPoints = deindex(std::get<0>(domain), std::get<1>(domain)).begin();
      sample<degree>(controlPoints, domainPoints, surface.getNumberOfPatches(), nSamples, std::forward<Visitor>(visit));
 }
 
+/**
+ * Sample the pth patch uniformly with nSamples[p] samples per edge and triangulate the samples.  Patches that share an edge, that is, all the control points on it (see make_partners), share the samples on that edge, and patches that share a corner control point share the corner.  Every shared sample is evaluated once, by the patch with the smaller edge index, so the mesh is crack-free and has no duplicate vertices.
+ * A shared edge is sampled like the finer of its two patches.  The coarser patch fans the extra samples on its edge from the opposite vertex of the triangle at the edge or, at a corner where two edges are finer, from a sample at the center of the triangle, so there are no T-junctions.  The number of segments, that is, samples minus one, of one patch must divide the number of segments of each of its neighbors or be divisible by it; powers of two plus one work.
+ * The triangles of a patch are oriented like the triangle of its corners.
+ * If the vertex has a normal, like VertexPN, the factory is called with the sample and the normal of the patch at the sample.
+ */
+template<class Space, hpuint degree, class Vertex = VertexP<Space>, class VertexFactory = happah::VertexFactory<Vertex>, class Index, typename = typename std::enable_if<(degree > 0)>::type>
+TriangleMesh<Vertex> tessellate(const SurfaceSplineBEZ<Space, degree, Index>& surface, const std::vector<hpuint>& nSamples, VertexFactory&& factory = VertexFactory()) {
+     using Point = typename Space::POINT;
+     static_assert(std::is_base_of<Vertex, decltype(factory(Point(0.0)))>::value, "The vertex generated by the factory must be a subclass of the vertex with which the triangle mesh is parameterized.");
+     static constexpr hpuint nControlPoints = SurfaceUtilsBEZ::get_number_of_control_points<degree>::value;
+
+     auto& points = surface.getControlPoints();
+     auto& indices = std::get<1>(surface.getPatches());
+     hpuint nPatches = surface.getNumberOfPatches();
+     assert(nSamples.size() == nPatches);
+     auto corner = [&](hpuint p, hpuint i) -> hpuint { return indices[p * nControlPoints + ((i == 0) ? 0 : (i == 1) ? degree : nControlPoints - 1)]; };
+     auto segments = [&](hpuint p) -> hpuint { assert(nSamples[p] > 1); return nSamples[p] - 1; };
+
+     //NOTE: Partners are the same edge seen from the neighboring patch; see make_partners.
+     Indices partners;
+     std::vector<char> reversed;
+     std::tie(partners, reversed) = make_partners(surface);
+
+     //NOTE: An edge has as many segments as the finer of its patches; the ratio tells how many segments of the edge lie on one segment of the patch.
+     Indices nEdgeSegments(3 * nPatches);
+     cilk_for(hpuint e = 0; e < 3 * nPatches; ++e) {
+          auto n = segments(e / 3);
+          auto m = (partners[e] == UNULL) ? n : segments(partners[e] / 3);
+          assert(n % m == 0 || m % n == 0);
+          nEdgeSegments[e] = std::max(n, m);
+     }
+     auto ratio = [&](hpuint e) { return nEdgeSegments[e] / segments(e / 3); };
+
+     //NOTE: The triangle at a corner is split at its center if both of its edges on the border of the patch are finer than the patch.  If the patch has one segment, its only triangle is split if two of its edges are finer.
+     auto centered = [&](hpuint p, hpuint k, hpuint j) {
+          auto n = segments(p);
+          auto nFiner = ((k == 0 && ratio(3 * p) > 1) ? 1 : 0) + ((j + k + 1 == n && ratio(3 * p + 1) > 1) ? 1 : 0) + ((j == 0 && ratio(3 * p + 2) > 1) ? 1 : 0);
+          return nFiner > 1;
+     };
+     auto count_centers = [&](hpuint p) -> hpuint {
+          auto n = segments(p);
+          if(n == 1) return centered(p, 0, 0) ? 1 : 0;
+          return (centered(p, 0, 0) ? 1 : 0) + (centered(p, 0, n - 1) ? 1 : 0) + (centered(p, n - 1, 0) ? 1 : 0);
+     };
+
+     //NOTE: The vertices are the corners, then the samples on the edges, and then the samples in the interiors of the patches followed by the centers of their split triangles.
+     Indices corners(points.size(), UNULL);
+     hpuint nVertices = 0;
+     for(hpuint p = 0; p < nPatches; ++p) for(hpuint i = 0; i < 3; ++i) {
+          auto& vertex = corners[corner(p, i)];
+          if(vertex == UNULL) vertex = nVertices++;
+     }
+     auto nCorners = nVertices;
+     Indices edges(3 * nPatches);
+     for(hpuint e = 0; e < 3 * nPatches; ++e) if(partners[e] == UNULL || e < partners[e]) {
+          edges[e] = nVertices;
+          nVertices += nEdgeSegments[e] - 1;
+     }
+     for(hpuint e = 0; e < 3 * nPatches; ++e) if(partners[e] != UNULL && partners[e] < e) edges[e] = edges[partners[e]];
+     Indices interiors(nPatches + 1), offsets(nPatches + 1);
+     interiors[0] = nVertices;
+     offsets[0] = 0;
+     for(hpuint p = 0; p < nPatches; ++p) {
+          auto n = segments(p);
+          auto nCenters = count_centers(p);
+          interiors[p + 1] = interiors[p] + (n - 1) * (n - 2) / 2 + nCenters;
+          offsets[p + 1] = offsets[p] + 3 * (n * n + n * (ratio(3 * p) + ratio(3 * p + 1) + ratio(3 * p + 2) - 3) + 2 * nCenters);
+     }
+     nVertices = interiors[nPatches];
+
+     auto edge_vertex = [&](hpuint e, hpuint t) { return edges[e] + ((partners[e] != UNULL && partners[e] < e && reversed[e]) ? nEdgeSegments[e] - 2 - t : t); };
+
+     std::vector<hpuint> patches(nVertices);
+     std::vector<hpreal> us(nVertices), vs(nVertices);
+     for(hpuint p = nPatches; p-- > 0; ) for(hpuint i = 0; i < 3; ++i) {//NOTE: Backwards so that the first patch that contains a corner is the one that evaluates it.
+          auto s = corners[corner(p, i)];
+          patches[s] = p;
+          us[s] = (i == 0) ? 1.0 : 0.0;
+          vs[s] = (i == 1) ? 1.0 : 0.0;
+     }
+     cilk_for(hpuint e = 0; e < 3 * nPatches; ++e) {
+          if(partners[e] != UNULL && partners[e] < e) continue;
+          auto p = e / 3, i = e % 3;
+          auto delta = 1.0 / nEdgeSegments[e];
+          for(hpuint t = 0; t + 1 < nEdgeSegments[e]; ++t) {
+               auto s = edges[e] + t;
+               auto x = (t + 1) * delta;
+               patches[s] = p;
+               us[s] = (i == 0) ? 1.0 - x : (i == 1) ? 0.0 : x;
+               vs[s] = (i == 0) ? x : (i == 1) ? 1.0 - x : 0.0;
+          }
+     }
+     //NOTE: The sample in the kth row and jth column of a patch has the parameters ((n - j - k) / n, j / n, k / n); see SurfaceUtilsBEZ::sample.
+     cilk_for(hpuint p = 0; p < nPatches; ++p) {
+          auto n = segments(p);
+          auto delta = 1.0 / n;
+          auto s = interiors[p];
+          for(hpuint k = 1; k + 1 < n; ++k) for(hpuint j = 1; j + k < n; ++j, ++s) {
+               patches[s] = p;
+               us[s] = (n - j - k) * delta;
+               vs[s] = j * delta;
+          }
+          for(hpuint k = 0; k < n; ++k) for(hpuint j = 0; j + k < n; ++j) if(centered(p, k, j)) {
+               patches[s] = p;
+               us[s] = (n - j - k - 2.0 / 3.0) * delta;
+               vs[s] = (j + 1.0 / 3.0) * delta;
+               ++s;
+          }
+     }
+
+     //NOTE: If the vertices have normals, the normals are computed from the partial derivatives, which fall out of the same de Casteljau pass.  Corners take the normal of the first patch that contains them.
+     std::vector<Point> samples(nVertices);
+     std::vector<Vertex> vertices;
+     vertices.reserve(nVertices);
+     auto controlPoints = deindex(points, indices);
+     if(contains_normal<Vertex>::value) {
+          using Vector = typename Space::VECTOR;
+
+          std::vector<Vector> partialsU(nVertices), partialsV(nVertices);
+          SurfaceUtilsBEZ::template evaluate<Space, degree>(controlPoints.begin(), patches.data(), us.data(), vs.data(), nVertices, samples.data(), partialsU.data(), partialsV.data());
+          for(hpuint s = 0; s < nVertices; ++s) vertices.push_back(factory(samples[s], SurfaceUtilsBEZ::getNormal(partialsU[s], partialsV[s])));
+     } else {
+          SurfaceUtilsBEZ::template evaluate<Space, degree>(controlPoints.begin(), patches.data(), us.data(), vs.data(), nVertices, samples.data());
+          for(auto& sample : samples) vertices.push_back(factory(sample));
+     }
+
+     Indices triangles(offsets[nPatches]);
+     cilk_for(hpuint p = 0; p < nPatches; ++p) {
+          auto n = segments(p);
+          auto offset = [&](hpuint k) { return k * (n + 1) - k * (k - 1) / 2; };
+          Indices local(SurfaceUtilsBEZ::getNumberOfControlPoints(n));
+          local[0] = corners[corner(p, 0)];
+          local[n] = corners[corner(p, 1)];
+          local[offset(n)] = corners[corner(p, 2)];
+          for(hpuint t = 1; t < n; ++t) {
+               local[offset(0) + t] = edge_vertex(3 * p, t * ratio(3 * p) - 1);
+               local[offset(t) + n - t] = edge_vertex(3 * p + 1, t * ratio(3 * p + 1) - 1);
+               local[offset(n - t)] = edge_vertex(3 * p + 2, t * ratio(3 * p + 2) - 1);
+          }
+          auto s = interiors[p];
+          for(hpuint k = 1; k + 1 < n; ++k) for(hpuint j = 1; j + k < n; ++j) local[offset(k) + j] = s++;
+
+          auto triangle = triangles.begin() + offsets[p];
+          auto push_triangle = [&](hpuint v0, hpuint v1, hpuint v2) {
+               *(triangle++) = v0;
+               *(triangle++) = v1;
+               *(triangle++) = v2;
+          };
+          //NOTE: The polygon holds the corners of a triangle at the border of the patch and the samples of the finer edges between them; the ith corner is at positions[i].
+          Indices polygon;
+          hpuint positions[3];
+          auto push_side = [&](hpuint vertex, bool border, hpuint i, hpuint t) {
+               polygon.push_back(vertex);
+               auto r = ratio(3 * p + i);
+               if(border) for(hpuint q = 1; q < r; ++q) polygon.push_back(edge_vertex(3 * p + i, t * r + q - 1));
+          };
+          for(hpuint k = 0; k < n; ++k) {
+               auto row0 = offset(k), row1 = offset(k + 1);
+               for(hpuint j = 0; j + k < n; ++j) {
+                    auto v0 = local[row0 + j], v1 = local[row0 + j + 1], v2 = local[row1 + j];
+                    polygon.clear();
+                    positions[0] = 0;
+                    push_side(v0, k == 0, 0, j);
+                    positions[1] = polygon.size();
+                    push_side(v1, j + k + 1 == n, 1, k);
+                    positions[2] = polygon.size();
+                    push_side(v2, j == 0, 2, n - k - 1);
+                    hpuint m = polygon.size();
+                    if(m == 3) push_triangle(v0, v1, v2);
+                    else if(centered(p, k, j)) {
+                         auto center = s++;
+                         for(hpuint l = 0; l < m; ++l) push_triangle(polygon[l], polygon[(l + 1) % m], center);
+                    } else {
+                         auto i = (positions[1] > 1) ? 0 : (positions[2] > positions[1] + 1) ? 1 : 2;
+                         auto apex = polygon[positions[(i + 2) % 3]];
+                         auto end = (i == 2) ? m : positions[i + 1];
+                         for(hpuint l = positions[i]; l < end; ++l) push_triangle(polygon[l], polygon[(l + 1) % m], apex);
+                    }
+                    if(j + k + 1 == n) continue;
+                    push_triangle(local[row0 + j + 1], local[row1 + j + 1], local[row1 + j]);
+               }
+          }
+          assert(triangle == triangles.begin() + offsets[p + 1] && s == interiors[p + 1]);
+     }
+
+     return make_triangle_mesh(std::move(vertices), std::move(triangles));
+}
+
+/**
+ * Same as above but every patch is sampled with nSamples samples per edge.
+ */
+template<class Space, hpuint degree, class Vertex = VertexP<Space>, class VertexFactory = happah::VertexFactory<Vertex>, class Index, typename = typename std::enable_if<(degree > 0)>::type>
+TriangleMesh<Vertex> tessellate(const SurfaceSplineBEZ<Space, degree, Index>& surface, hpuint nSamples, VertexFactory&& factory = VertexFactory()) { return tessellate<Space, degree, Vertex>(surface, std::vector<hpuint>(surface.getNumberOfPatches(), nSamples), std::forward<VertexFactory>(factory)); }
+
+/**
+ * Tessellate the surface such that the triangles deviate from the patches by at most the tolerance.  Every patch is subdivided uniformly into a power of two segments per edge, as few as the bound in SurfaceUtilsBEZ::getSecondDerivativeBound allows, so flat patches get few triangles and curved patches many.  Neighboring patches are stitched as described above, so the mesh is crack-free and has no T-junctions.
+ * @param[tolerance] Largest distance between the surface and the mesh; must be positive.
+ */
+template<class Space, hpuint degree, class Vertex = VertexP<Space>, class VertexFactory = happah::VertexFactory<Vertex>, class Index, typename = typename std::enable_if<(degree > 0)>::type>
+TriangleMesh<Vertex> tessellate_adaptively(const SurfaceSplineBEZ<Space, degree, Index>& surface, hpreal tolerance, VertexFactory&& factory = VertexFactory()) {
+     assert(tolerance > 0);
+     static constexpr hpuint nControlPoints = SurfaceUtilsBEZ::get_number_of_control_points<degree>::value;
+
+     auto patches = surface.getPatches();
+     auto controlPoints = deindex(std::get<0>(patches), std::get<1>(patches)).begin();
+     hpuint nPatches = surface.getNumberOfPatches();
+     std::vector<hpuint> nSamples(nPatches);
+     cilk_for(hpuint p = 0; p < nPatches; ++p) {
+          auto bound = SurfaceUtilsBEZ::template getSecondDerivativeBound<Space, degree>(controlPoints + p * nControlPoints);
+          auto n = std::ceil(std::sqrt(bound / (6 * tolerance)));
+          hpuint nSegments = 1;
+          while(nSegments < n) nSegments <<= 1;
+          nSamples[p] = nSegments + 1;
+     }
+     return tessellate<Space, degree, Vertex>(surface, nSamples, std::forward<VertexFactory>(factory));
+}
+
 }//namespace happah
@@ -5,7 +5,11 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cilk/cilk.h>
 #include <glm/gtx/norm.hpp>
+#include <unordered_map>
 #include <vector>
 
 #include "happah/Happah.h"
@@ -47,43 +51,78 @@ public:
           });
      }
 
+     /**
+      * Multiply the control points of every patch by powers of the factors at the corners of its parameter triangle; the control point with indices (i0, i1, i2) of the pth patch is multiplied by f0^i0 * f1^i1 * f2^i2, where f0, f1, and f2 are the factors at the corners of the pth triangle.  A control point used by several patches stays shared by the uses that multiply it by the same powers of the same factors, for example, the control points on an edge between two patches whose parameter triangles share the edge; the other uses get copies.  The patches are reparametrized in parallel.
+      * @param[in] factors,indices Factors and, for every patch, the indices of the factors at the three corners of its parameter triangle.
+      */
      void reparametrize(const std::vector<hpreal>& factors, const Indices& indices) {
           //TODO: get rid of std::pair in project and just use std::tuple for everything
-          //TODO: Similar control points can be shared between different edges and/or patches.  Therefore, we cannot reuse the original control point indices but generate new ones.  We can optimize slightly; any control points shared on an edge between two adjacent patches can be shared in the resulting reparametrization.  In fact, for usability in the graphical interface, these should be the same if they are the same originally.  Thus, we need a data structure that tells us which edges are shared and update the generated control point indices accordingly.
-          //TODO: microoptimizations; skip computation on shared edges
-
-          auto n = m_indices.size();
-
-          ControlPoints controlPoints;
-          controlPoints.reserve(n);
-
-          auto j = m_indices.cbegin();
-          visit_triangles(factors, indices, [&](hpreal f0, hpreal f1, hpreal f2) {
-               auto rowLength = t_degree + 1u;
-               while(rowLength > 0u) {
-                    hpreal factor = std::pow(f0, rowLength - 1u) * std::pow(f2, t_degree - rowLength + 1u);
-                    auto end = j + rowLength;
-                    while(j != end) {
-                         controlPoints.push_back(m_controlPoints[*j] * factor);
-                         factor /= f0;
-                         factor *= f1;
-                         ++j;
+          static constexpr hpuint nControlPoints = SurfaceUtilsBEZ::get_number_of_control_points<t_degree>::value;
+          using Key = std::array<hpuint, 7>;//NOTE: The control point and the indices of the factors with their exponents, sorted by index.
+
+          auto nPatches = getNumberOfPatches();
+          assert(indices.size() == 3 * nPatches);
+
+          std::vector<hpuint> nUses(m_controlPoints.size(), 0);
+          for(auto i : m_indices) ++nUses[i];
+
+          //NOTE: A use of a control point owns its reparametrized control point if it is the first use with its powers; only owners write.
+          auto getHash = [](const Key& key) -> std::size_t {
+               std::size_t hash = 0;
+               for(auto k : key) hash = 31 * hash + k;
+               return hash;
+          };
+          std::unordered_map<Key, hpuint, decltype(getHash)> map(0, getHash);
+          Indices reparametrizedIndices(m_indices.size());
+          std::vector<char> owners(m_indices.size(), true);
+          hpuint nPoints = 0;
+          for(hpuint p = 0; p < nPatches; ++p) {
+               auto c = p * nControlPoints;
+               for(hpuint k = 0; k <= t_degree; ++k) for(hpuint j = 0; j + k <= t_degree; ++j, ++c) {
+                    auto i = m_indices[c];
+                    if(nUses[i] == 1) {
+                         reparametrizedIndices[c] = nPoints++;
+                         continue;
                     }
-                    --rowLength;
+                    std::pair<hpuint, hpuint> powers[3] = { { indices[3 * p], t_degree - j - k }, { indices[3 * p + 1], j }, { indices[3 * p + 2], k } };
+                    for(auto& power : powers) if(power.second == 0) power.first = UNULL;
+                    std::sort(powers, powers + 3);
+                    auto result = map.emplace(Key{ i, powers[0].first, powers[0].second, powers[1].first, powers[1].second, powers[2].first, powers[2].second }, nPoints);
+                    if(result.second) ++nPoints;
+                    else owners[c] = false;
+                    reparametrizedIndices[c] = result.first->second;
                }
-          });
+          }
+
+          ControlPoints controlPoints(nPoints);
+          cilk_for(hpuint p = 0; p < nPatches; ++p) {
+               hpreal powers0[t_degree + 1], powers1[t_degree + 1], powers2[t_degree + 1];
+               auto f0 = factors[indices[3 * p]], f1 = factors[indices[3 * p + 1]], f2 = factors[indices[3 * p + 2]];
+               powers0[0] = powers1[0] = powers2[0] = 1.0;
+               for(hpuint i = 1; i <= t_degree; ++i) {
+                    powers0[i] = powers0[i - 1] * f0;
+                    powers1[i] = powers1[i - 1] * f1;
+                    powers2[i] = powers2[i - 1] * f2;
+               }
+               auto c = p * nControlPoints;
+               for(hpuint k = 0; k <= t_degree; ++k) for(hpuint j = 0; j + k <= t_degree; ++j, ++c) if(owners[c]) controlPoints[reparametrizedIndices[c]] = m_controlPoints[m_indices[c]] * (powers0[t_degree - j - k] * powers1[j] * powers2[k]);
+          }
           m_controlPoints.swap(controlPoints);
-          
-          m_indices.clear();
-          m_indices.reserve(n);
-          for(auto i = 0lu; i < n; ++i) m_indices.push_back(i);
+          m_indices.swap(reparametrizedIndices);
      }
 
      void operator+=(const SurfaceSplineHEZ<Space, t_degree>& surface) {
           //TODO: surface must have the same parameter space
           //TODO: maybe compare indices using simd?
           if(m_indices == surface.m_indices) for(auto i = m_controlPoints.begin(), j = surface.m_controlPoints.cbegin(), end = m_controlPoints.end(); i != end; ++i, ++j) *i += *j;
-          else throw std::runtime_error("+= with different control point indices is not implemented yet.");
+          else {
+               //NOTE: An initializer list would copy both surfaces.
+               std::vector<SurfaceSplineHEZ<Space, t_degree> > surfaces;
+               surfaces.reserve(2);
+               surfaces.emplace_back(std::move(*this));
+               surfaces.push_back(surface);
+               *this = combine(std::vector<hpreal>{ 1.0, 1.0 }, surfaces);
+          }
      }
 
      void operator*=(hpreal a) { for(auto& controlPoint : m_controlPoints) controlPoint *= a; }
@@ -109,6 +148,66 @@ using QuadraticSurfaceSplineHEZ = SurfaceSplineHEZ<Space, 2>;
 template<class Space>
 using QuarticSurfaceSplineHEZ = SurfaceSplineHEZ<Space, 4>;
 
+/**
+ * Sum the splines weighted by the coefficients in one pass.  The splines must have the same number of patches but their control points may be indexed differently.  Two uses of control points are the same control point of the sum if they are the same control point in every spline, so the sum shares as many control points as all the splines share; the indices are merged spline by spline, and then the control points of the sum are computed in parallel, each from its first use.
+ */
+template<class Space, hpuint degree>
+SurfaceSplineHEZ<Space, degree> combine(const std::vector<hpreal>& coefficients, const std::vector<SurfaceSplineHEZ<Space, degree> >& surfaces) {
+     using Point = typename Space::POINT;
+     assert(coefficients.size() == surfaces.size() && !surfaces.empty());
+
+     auto& indices = std::get<1>(surfaces[0].getPatches());
+     auto n = indices.size();
+     auto nSurfaces = surfaces.size();
+     auto same = std::all_of(std::begin(surfaces) + 1, std::end(surfaces), [&](const SurfaceSplineHEZ<Space, degree>& surface) { return std::get<1>(surface.getPatches()) == indices; });
+     if(same) {
+          auto nControlPoints = surfaces[0].getControlPoints().size();
+          std::vector<Point> controlPoints(nControlPoints);
+          cilk_for(hpuint c = 0; c < nControlPoints; ++c) {
+               auto point = coefficients[0] * surfaces[0].getControlPoints()[c];
+               for(hpuint s = 1; s < nSurfaces; ++s) point += coefficients[s] * surfaces[s].getControlPoints()[c];
+               controlPoints[c] = point;
+          }
+          return { std::move(controlPoints), indices };
+     }
+
+     //NOTE: After merging the first s splines, two uses have the same label if they are the same control point in each of the s splines.
+     Indices labels(indices);
+     hpuint nLabels = surfaces[0].getControlPoints().size();
+     std::unordered_map<uint64_t, hpuint> map;
+     for(hpuint s = 1; s < nSurfaces; ++s) {
+          auto& others = std::get<1>(surfaces[s].getPatches());
+          assert(others.size() == n);
+          map.clear();
+          map.reserve(nLabels);
+          nLabels = 0;
+          for(hpuint i = 0; i < n; ++i) {
+               auto result = map.emplace((uint64_t(labels[i]) << 32) | others[i], nLabels);
+               if(result.second) ++nLabels;
+               labels[i] = result.first->second;
+          }
+     }
+
+     //NOTE: The first use of a label writes the control point.
+     Indices owners(nLabels, UNULL);
+     for(hpuint i = 0; i < n; ++i) if(owners[labels[i]] == UNULL) owners[labels[i]] = i;
+     std::vector<Point> controlPoints(nLabels);
+     cilk_for(hpuint l = 0; l < nLabels; ++l) {
+          auto i = owners[l];
+          auto point = coefficients[0] * surfaces[0].getControlPoints()[indices[i]];
+          for(hpuint s = 1; s < nSurfaces; ++s) point += coefficients[s] * surfaces[s].getControlPoints()[std::get<1>(surfaces[s].getPatches())[i]];
+          controlPoints[l] = point;
+     }
+     return { std::move(controlPoints), std::move(labels) };
+}
+
+//NOTE: The patches are restricted to the parameter triangle u + v + w = 1, on which they are B\'ezier patches with the same control points, and projected like the patches of a B\'ezier spline.
+template<hpuint degree>
+BoundingVolumeHierarchy make_bounding_volume_hierarchy(const SurfaceSplineHEZ<Space3D, degree>& surface, hpuint nSubdivisions = 2) { return make_bounding_volume_hierarchy(SurfaceSplineBEZ<Space3D, degree>(surface.getControlPoints(), std::get<1>(surface.getPatches())), nSubdivisions); }
+
+template<hpuint degree>
+std::vector<std::tuple<hpuint, hpreal, hpreal, hpreal> > project(const SurfaceSplineHEZ<Space3D, degree>& surface, const BoundingVolumeHierarchy& hierarchy, const std::vector<Point3D>& points, hpreal epsilon = EPSILON) { return project(SurfaceSplineBEZ<Space3D, degree>(surface.getControlPoints(), std::get<1>(surface.getPatches())), hierarchy, points, epsilon); }
+
 template<hpuint degree>
 SurfaceSplineHEZ<Space4D, degree> operator*(const SurfaceSplineHEZ<Space1D, degree>& surface, const Point4D& p) {
      std::vector<Point4D> controlPoints;
@@ -5,136 +5,222 @@
 
 #include "happah/geometries/TriangleMesh.h"
 
-namespace happah {
+#include <atomic>
+#include <cilk/cilk.h>
+#include <numeric>
 
-std::vector<Edge> make_edges(const std::vector<hpuint>& indices) {
-     std::vector<Edge> edges;
-
-     auto nEdges = indices.size();//NOTE: The number of edges is >= to 3x the number of triangles; the number is greater if the mesh is not closed, that is, it has a border.
-     edges.reserve(nEdges);
+namespace happah {
 
-     using Key = std::pair<hpuint, hpuint>;
-     using Value = hpuint;
+std::vector<hpuint> make_opposites(const Indices& indices) {
+     auto nEdges = indices.size();
+     hpuint nVertices = (nEdges > 0) ? *std::max_element(std::begin(indices), std::end(indices)) + 1 : 0;
 
-     auto getHash = [](const Key& k) -> uint64_t {
-          int32_t d = k.first - k.second;
-          int32_t min = k.second + (d & d >> 31);
-          int32_t max = k.first - (d & d >> 31);
-          return ((uint64_t)max << 32 | min);
+     auto get_vertices = [&](hpuint e) -> std::pair<hpuint, hpuint> {
+          auto t = e - e % 3;
+          auto va = indices[e];
+          auto vb = indices[t + (e - t + 1) % 3];
+          return (va < vb) ? std::make_pair(va, vb) : std::make_pair(vb, va);
      };
 
-     auto isKeysEqual = [](const Key& k1, const Key& k2) { return (k1.first == k2.first && k1.second == k2.second) || (k1.first == k2.second && k1.second == k2.first); };
+     //NOTE: Bucket the edges by their smaller endpoint (a counting sort on the high half of the 64-bit (min,max) key) so that matching edges only have to be searched for among the edges around one vertex.
+     std::vector<std::atomic<hpuint> > cursors(nVertices);
+     cilk_for(hpuint e = 0; e < nEdges; ++e) cursors[get_vertices(e).first].fetch_add(1, std::memory_order_relaxed);
 
-     using Map = std::unordered_map<Key, Value, decltype(getHash), decltype(isKeysEqual)>;
-     Map map(nEdges, getHash, isKeysEqual);
+     Indices offsets(nVertices + 1);
+     offsets[0] = 0;
+     for(auto v = 0u; v < nVertices; ++v) {
+          offsets[v + 1] = offsets[v] + cursors[v].load(std::memory_order_relaxed);
+          cursors[v].store(offsets[v], std::memory_order_relaxed);
+     }
 
-     auto e = 0u;
+     //NOTE: The low half of the key is the edge and not the smaller endpoint, which is implied by the bucket.
+     std::vector<uint64_t> keys(nEdges);
+     cilk_for(hpuint e = 0; e < nEdges; ++e) {
+          auto vertices = get_vertices(e);
+          keys[cursors[vertices.first].fetch_add(1, std::memory_order_relaxed)] = (uint64_t(vertices.second) << 32) | e;
+     }
 
-     auto push_edge = [&](hpuint va, hpuint vb, hpuint next, hpuint previous) {
-          auto key = Key(va, vb);
-          auto i = map.find(key);
-          if(i == map.end()) {
-               map[key] = e;
-               edges.emplace_back(vb, next, UNULL, previous);
-          } else {
-               auto opposite = (*i).second;
-               edges[opposite].opposite = e;
-               edges.emplace_back(vb, next, opposite, previous);
+     //NOTE: If more than two edges share the same endpoints, the first edge is paired with the last and all other edges are paired with the first.
+     std::vector<hpuint> opposites(nEdges, UNULL);
+     cilk_for(hpuint v = 0; v < nVertices; ++v) {
+          auto begin = keys.begin() + offsets[v];
+          auto end = keys.begin() + offsets[v + 1];
+          std::sort(begin, end);
+          while(begin != end) {
+               auto i = begin + 1;
+               while(i != end && (*i >> 32) == (*begin >> 32)) ++i;
+               if(i - begin > 1) {
+                    hpuint first = hpuint(*begin);
+                    opposites[first] = hpuint(*(i - 1));
+                    std::for_each(begin + 1, i, [&](uint64_t key) { opposites[hpuint(key)] = first; });
+               }
+               begin = i;
           }
-     };
-
-     for(auto i = std::begin(indices), end = std::end(indices); i != end; ++i) {
-          auto v0 = *i;
-          auto v1 = *(++i);
-          auto v2 = *(++i);
-
-          auto e0 = e;
-          auto e1 = e + 1;
-          auto e2 = e + 2;
-
-          push_edge(v0, v1, e1, e2);
-          ++e;
-          push_edge(v1, v2, e2, e0);
-          ++e;
-          push_edge(v2, v0, e0, e1);
-          ++e;
      }
 
-     assert(edges.size() == indices.size());
+     return opposites;
+}
+
+std::vector<Edge> make_border_edges(const Indices& indices, Indices& opposites) {
+     std::vector<Edge> border;
+     hpuint nEdges = indices.size();
+     auto previous = [](hpuint e) -> hpuint { auto t = e - e % 3; return t + (e - t + 2) % 3; };
 
-     auto i = std::find_if(std::begin(edges), std::end(edges), [](const Edge& edge) { return edge.opposite == UNULL; });
-     if(i != edges.end()) {
-          e = std::distance(edges.begin(), i);
-          auto begin = e;
-          auto next = indices.size();
-          auto previous = next - 2;
+     for(hpuint begin = 0; begin < nEdges; ++begin) {
+          if(opposites[begin] != UNULL) continue;
+          hpuint first = nEdges + border.size();
+          auto e = begin;
           do {
-               (*i).opposite = next;
-               i = edges.begin() + (*i).previous;
-               edges.emplace_back((*i).vertex, ++next, e, ++previous);
-               e = edges[(*i).opposite].previous;
-               i = edges.begin() + e;
-          } while(e != begin);
-          edges[indices.size()].previous = edges.size() - 1;
-          edges.back().next = indices.size();
+               hpuint b = nEdges + border.size();
+               opposites[e] = b;
+               border.emplace_back(indices[e], b + 1, e, b - 1);
+               e = previous(e);
+               while(e != begin && opposites[e] != UNULL && opposites[e] < nEdges) e = previous(opposites[e]);
+          } while(e != begin && opposites[e] == UNULL);
+          border[first - nEdges].previous = nEdges + border.size() - 1;
+          border.back().next = first;
+     }
+
+     return border;
+}
+
+std::vector<Edge> make_edges(const std::vector<hpuint>& indices) {
+     auto opposites = make_opposites(indices);
+     auto border = make_border_edges(indices, opposites);
+     auto nEdges = indices.size();//NOTE: The number of edges is >= to 3x the number of triangles; the number is greater if the mesh is not closed, that is, it has a border.
+     std::vector<Edge> edges;
+     edges.reserve(nEdges + border.size());
+     edges.resize(nEdges);
+
+     cilk_for(hpuint e = 0; e < nEdges; ++e) {
+          auto t = e - e % 3;
+          auto next = t + (e - t + 1) % 3;
+          auto previous = t + (e - t + 2) % 3;
+          edges[e] = Edge(indices[next], next, opposites[e], previous);
      }
+     edges.insert(edges.end(), border.begin(), border.end());
 
      return edges;
 }//make_edges
 
-boost::optional<hpuint> find_in_ring(const std::vector<Edge>& edges, hpuint begin, hpuint v) { return find_if_in_spokes(edges, begin, [&](const Edge& edge) { return edge.vertex == v; }); }
+std::vector<hpuint> make_triangle_order(const Indices& indices, hpuint cacheSize) {
+     hpuint nTriangles = indices.size() / 3;
+     hpuint nVertices = (nTriangles > 0) ? *std::max_element(std::begin(indices), std::end(indices)) + 1 : 0;
+
+     //NOTE: The triangles around every vertex in compressed sparse row format; live counts the triangles around a vertex that have not been emitted yet.
+     Indices live(nVertices, 0);
+     for(auto v : indices) ++live[v];
+     Indices offsets(nVertices + 1);
+     offsets[0] = 0;
+     for(auto v = 0u; v < nVertices; ++v) offsets[v + 1] = offsets[v] + live[v];
+     Indices fans(indices.size());
+     {
+          Indices cursors(offsets.begin(), offsets.end() - 1);
+          for(auto i = 0u, end = hpuint(indices.size()); i < end; ++i) fans[cursors[indices[i]]++] = i / 3;
+     }
 
-std::vector<hpuint> make_neighbors(const Indices& indices) {
-     using Key = std::pair<hpuint, hpuint>;
-     using Value = std::pair<hpuint, hpuint>;
-
-     auto getHash = [](const Key& k) -> uint64_t {
-          int32_t d = k.first - k.second;
-          int32_t min = k.second + (d & d >> 31);
-          int32_t max = k.first - (d & d >> 31);
-          return ((uint64_t)max << 32 | min);
+     Indices order;
+     order.reserve(nTriangles);
+     Indices timestamps(nVertices, 0);
+     boost::dynamic_bitset<> emitted(nTriangles, false);
+     Indices deadEnds;
+     Indices candidates;
+     hpuint time = cacheSize + 1;
+     hpuint cursor = 0;
+     hpuint fan = (nVertices > 0) ? 0 : UNULL;
+
+     auto get_next_fan = [&]() -> hpuint {
+          auto best = UNULL;
+          auto priority = -1l;
+          for(auto v : candidates) {
+               if(live[v] == 0) continue;
+               auto p = 0l;
+               if(time - timestamps[v] + 2 * live[v] <= cacheSize) p = time - timestamps[v];
+               if(p > priority) {
+                    priority = p;
+                    best = v;
+               }
+          }
+          if(best != UNULL) return best;
+          while(!deadEnds.empty()) {
+               auto v = deadEnds.back();
+               deadEnds.pop_back();
+               if(live[v] > 0) return v;
+          }
+          while(cursor < nVertices) {
+               if(live[cursor] > 0) return cursor;
+               ++cursor;
+          }
+          return UNULL;
      };
 
-     auto isKeysEqual = [](const Key& k1, const Key& k2) { return (k1.first == k2.first && k1.second == k2.second) || (k1.first == k2.second && k1.second == k2.first); };
+     while(fan != UNULL) {
+          candidates.clear();
+          std::for_each(fans.begin() + offsets[fan], fans.begin() + offsets[fan + 1], [&](hpuint t) {
+               if(emitted[t]) return;
+               emitted[t] = true;
+               order.push_back(t);
+               visit_triplet(indices, t, [&](hpuint v0, hpuint v1, hpuint v2) {
+                    for(auto v : { v0, v1, v2 }) {
+                         deadEnds.push_back(v);
+                         candidates.push_back(v);
+                         --live[v];
+                         if(time - timestamps[v] > cacheSize) timestamps[v] = time++;
+                    }
+               });
+          });
+          fan = get_next_fan();
+     }
 
-     using Map = std::unordered_map<Key, Value, decltype(getHash), decltype(isKeysEqual)>;
+     return order;
+}
 
-     std::vector<hpuint> neighbors;
-     neighbors.reserve(indices.size());
+boost::optional<hpuint> find_in_ring(const std::vector<Edge>& edges, hpuint begin, hpuint v) { return find_if_in_spokes(edges, begin, [&](const Edge& edge) { return edge.vertex == v; }); }
 
-     Map map(0, getHash, isKeysEqual);
-     hpuint triangle;
+std::tuple<Indices, Indices> make_fans(const std::vector<Edge>& edges, const Indices& outgoing, hpuint border) {
+     hpuint nVertices = outgoing.size();
+     Indices offsets(nVertices + 1);
+     offsets[0] = 0;
+     cilk_for(hpuint v = 0; v < nVertices; ++v) {
+          auto n = 0u;
+          visit_spokes(edges, outgoing[v], [&](const Edge& edge) { if(edge.next < border) ++n; });
+          offsets[v + 1] = n;
+     }
+     std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
 
-     auto cache = [&](hpuint va, hpuint vb) {
-          Key key(va, vb);
-          auto i = map.find(key);
-          if(i == map.end()) map[key] = Value(triangle, UNULL);
-          else i->second.second = triangle;
-     };
+     Indices triangles(offsets.back());
+     cilk_for(hpuint v = 0; v < nVertices; ++v) {
+          auto i = triangles.begin() + offsets[v];
+          visit_spokes(edges, outgoing[v], [&](const Edge& edge) { if(edge.next < border) *(i++) = edge.next / 3; });
+     }
 
-     triangle = 0;
-     visit_triplets(indices, [&](hpuint v0, hpuint v1, hpuint v2) {
-          cache(v0, v1);
-          cache(v1, v2);
-          cache(v2, v0);
-          ++triangle;
-     });
-
-     auto move = [&](hpuint va, hpuint vb) {
-          auto value = map[{ va, vb }];
-          if(value.first == triangle) neighbors.push_back(value.second);
-          else neighbors.push_back(value.first);
-     };
+     return std::make_tuple(std::move(offsets), std::move(triangles));
+}
 
-     triangle = 0;
-     visit_triplets(indices, [&](hpuint v0, hpuint v1, hpuint v2) {
-          move(v0, v1);
-          move(v1, v2);
-          move(v2, v0);
-          ++triangle;
-     });
+std::vector<hpuint> make_neighbors(const Indices& indices) {
+     auto opposites = make_opposites(indices);
+     cilk_for(hpuint e = 0; e < opposites.size(); ++e) if(opposites[e] != UNULL) opposites[e] /= 3;
+     return opposites;
+}
+
+std::tuple<Indices, Indices> make_rings(const std::vector<Edge>& edges, const Indices& outgoing) {
+     hpuint nVertices = outgoing.size();
+     Indices offsets(nVertices + 1);
+     offsets[0] = 0;
+     cilk_for(hpuint v = 0; v < nVertices; ++v) {
+          auto n = 0u;
+          visit_spokes(edges, outgoing[v], [&](const Edge& edge) { ++n; });
+          offsets[v + 1] = n;
+     }
+     std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+     Indices vertices(offsets.back());
+     cilk_for(hpuint v = 0; v < nVertices; ++v) {
+          auto i = vertices.begin() + offsets[v];
+          visit_spokes(edges, outgoing[v], [&](const Edge& edge) { *(i++) = edge.vertex; });
+     }
 
-     return neighbors;
+     return std::make_tuple(std::move(offsets), std::move(vertices));
 }
 
 }//namespace happah
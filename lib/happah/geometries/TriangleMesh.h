@@ -6,6 +6,10 @@
 #pragma once
 
 #include <boost/dynamic_bitset.hpp>
+#include <cilk/cilk.h>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
 #include <unordered_map>
 
 #include "happah/geometries/Geometry.h"
@@ -17,31 +21,44 @@
 
 namespace happah {
 
-enum class Format { DIRECTED_EDGE, SIMPLE };
+enum class Format { COMPACT_EDGE, DIRECTED_EDGE, SIMPLE };
 
 std::vector<hpuint> make_neighbors(const Indices& indices);
 
-template<class Vertex, Format t_format = Format::SIMPLE>
+//NOTE: The neighbors are computed on 32-bit indices, so the indices must not be wider than hpuint.
+template<class Index>
+std::vector<Index> make_neighbors(const std::vector<Index>& indices) {
+     static_assert(sizeof(Index) <= sizeof(hpuint), "Neighbors can only be computed for indices that fit into hpuint.");
+     auto neighbors = make_neighbors(Indices(indices.begin(), indices.end()));
+     std::vector<Index> result(neighbors.size());
+     std::transform(neighbors.begin(), neighbors.end(), result.begin(), [](hpuint n) { return (n == UNULL) ? INULL<Index> : Index(n); });
+     return result;
+}
+
+//NOTE: Only simple triangle meshes can be stored out of core or use indices other than hpuint; see make_mapped_triangle_mesh.
+template<class Vertex, Format t_format = Format::SIMPLE, class Storage = HeapStorage, class Index = hpuint>
 class TriangleMesh;
 
-template<class T, class Visitor>
-void visit_triangles(const std::vector<T>& ts, const std::vector<hpuint>& indices, Visitor&& visit) { visit_triplets(deindex(ts, indices).begin(), indices.size() / 3, 3, std::forward<Visitor>(visit)); }
+template<class T, class Index, class Visitor>
+void visit_triangles(const std::vector<T>& ts, const std::vector<Index>& indices, Visitor&& visit) { visit_triplets(deindex(ts, indices).begin(), indices.size() / 3, 3, std::forward<Visitor>(visit)); }
 
-template<class Vertex>
-class TriangleMesh<Vertex, Format::SIMPLE> : public Geometry2D<typename Vertex::SPACE>, public Mesh<Vertex> {
+template<class Vertex, class Storage, class Index>
+class TriangleMesh<Vertex, Format::SIMPLE, Storage, Index> : public Geometry2D<typename Vertex::SPACE>, public Mesh<Vertex, Storage, Index> {
+     using Indices = typename Mesh<Vertex, Storage, Index>::Indices;
      using Space = typename Vertex::SPACE;
-     using Vertices = typename Mesh<Vertex>::Vertices;
+     using Vertices = typename Mesh<Vertex, Storage, Index>::Vertices;
 
 public:
      TriangleMesh(Vertices vertices, Indices indices)
-          : Geometry2D<Space>(), Mesh<Vertex>(std::move(vertices), std::move(indices)) {}
+          : Geometry2D<Space>(), Mesh<Vertex, Storage, Index>(std::move(vertices), std::move(indices)) {}
 
-     template<Format format>
-     TriangleMesh(const TriangleMesh<Vertex, format>& mesh)
-          : TriangleMesh(mesh.getVertices(), mesh.getIndices()) {}
+     //NOTE: Copies the vertices and indices if the storage or the index type differs.
+     template<Format format, class S, class I>
+     TriangleMesh(const TriangleMesh<Vertex, format, S, I>& mesh)
+          : TriangleMesh(Vertices(mesh.getVertices().begin(), mesh.getVertices().end()), Indices(mesh.getIndices().begin(), mesh.getIndices().end())) {}
 
      template<Format format>
-     TriangleMesh(TriangleMesh<Vertex, format>&& mesh)
+     TriangleMesh(TriangleMesh<Vertex, format, Storage, Index>&& mesh)
           : TriangleMesh(std::move(mesh.getVertices()), std::move(mesh.getIndices())) {}
 
 };//TriangleMesh
@@ -54,54 +71,104 @@ struct Edge {
      hpuint previous;
      hpuint vertex;//vertex to which edge points
 
+     Edge() {}
+
      Edge(hpuint vertex, hpuint next, hpuint opposite, hpuint previous)
           : next(next), opposite(opposite), previous(previous), vertex(vertex) {}
 
 };
 
+//NOTE: Returns offsets and triangles in compressed sparse row format; the triangles around the vth vertex are in the range [offsets[v], offsets[v + 1]).  Edges with an index greater than or equal to border are border edges.
+std::tuple<Indices, Indices> make_fans(const std::vector<Edge>& edges, const Indices& outgoing, hpuint border);
+
+//NOTE: Returns offsets and vertices in compressed sparse row format; the neighbors of the vth vertex are in the range [offsets[v], offsets[v + 1]).
+std::tuple<Indices, Indices> make_rings(const std::vector<Edge>& edges, const Indices& outgoing);
+
+//NOTE: Walks the border loops of a mesh whose opposites were made by make_opposites and replaces the UNULL entries with the indices of the border edges, which are numbered consecutively, loop by loop, starting at indices.size().
+std::vector<Edge> make_border_edges(const Indices& indices, Indices& opposites);
+
 std::vector<Edge> make_edges(const std::vector<hpuint>& indices);
 
+//NOTE: The ith entry is the edge that runs in the opposite direction of the ith edge or UNULL if the ith edge is a border edge.  The edges are paired by sorting 64-bit (min,max) vertex keys in parallel.
+std::vector<hpuint> make_opposites(const Indices& indices);
+
+//NOTE: Returns the triangles in an order that makes good use of a vertex cache of the given size (Sander et al., Fast Triangle Reordering for Vertex Locality and Reduced Overdraw, 2007).  The ith entry is the triangle that is moved to the ith position.
+std::vector<hpuint> make_triangle_order(const Indices& indices, hpuint cacheSize = 32);
+
+//NOTE: Returns the vertices in the order in which a Z-order (Morton) curve through their bounding box visits them.  The ith entry is the vertex that is moved to the ith position.
+template<class Vertex>
+std::vector<hpuint> make_vertex_order(const std::vector<Vertex>& vertices) {
+     static constexpr hpuint DIMENSION = Vertex::SPACE::DIMENSION;
+     static constexpr hpuint N_BITS = std::min(31u, 63u / DIMENSION);
+     hpuint nVertices = vertices.size();
+     if(nVertices == 0) return {};
+
+     auto min = vertices[0].position;
+     auto max = min;
+     for(auto& vertex : vertices) for(auto i = 0u; i < DIMENSION; ++i) {
+          min[i] = std::min(min[i], vertex.position[i]);
+          max[i] = std::max(max[i], vertex.position[i]);
+     }
+     hpreal scale[DIMENSION];
+     for(auto i = 0u; i < DIMENSION; ++i) scale[i] = (max[i] > min[i]) ? hpreal((1u << N_BITS) - 1) / (max[i] - min[i]) : 0;
+
+     std::vector<std::pair<uint64_t, hpuint> > keys(nVertices);
+     cilk_for(hpuint v = 0; v < nVertices; ++v) {
+          auto& position = vertices[v].position;
+          hpuint coordinates[DIMENSION];
+          for(auto i = 0u; i < DIMENSION; ++i) coordinates[i] = hpuint((position[i] - min[i]) * scale[i]);
+          uint64_t key = 0;
+          for(auto b = N_BITS; b-- > 0; ) for(auto i = 0u; i < DIMENSION; ++i) key = (key << 1) | ((coordinates[i] >> b) & 1);
+          keys[v] = std::make_pair(key, v);
+     }
+     std::sort(keys.begin(), keys.end());
+
+     std::vector<hpuint> order(nVertices);
+     cilk_for(hpuint v = 0; v < nVertices; ++v) order[v] = keys[v].second;
+     return order;
+}
+
 template<class Test>
 boost::optional<hpuint> find_if_in_spokes(const std::vector<Edge>& edges, hpuint begin, Test&& test) {
      auto e = begin;
      do {
           auto& edge = edges[e];
           if(test(edge)) return e;
-          e = edges[edges[edge.next].next].opposite;
+          e = edges[edge.previous].opposite;
      } while(e != begin);
      return boost::none;
 }
 
 boost::optional<hpuint> find_in_ring(const std::vector<Edge>& edges, hpuint begin, hpuint v);
 
-template<class Visitor, bool closed = false>
-void visit_fan(const Indices& neighbors, hpuint t, hpuint i, Visitor&& visit) {
-     auto current = t;
+template<class Visitor, bool closed = false, class Index>
+void visit_fan(const std::vector<Index>& neighbors, hpsize t, hpuint i, Visitor&& visit) {
+     Index current = t;
 
      if(!closed) do {
-          hpuint previous;
-          visit_triplet(neighbors, current, [&](hpuint n0, hpuint n1, hpuint n2) { previous = (i == 0) ? n0 : (i == 1) ? n1 : n2; });
-          if(previous == UNULL) break;
-          visit_triplet(neighbors, previous, [&](hpuint n0, hpuint n1, hpuint n2) { i = (n0 == current) ? 1 : (n1 == current) ? 2 : 0; });
+          Index previous;
+          visit_triplet(neighbors, current, [&](Index n0, Index n1, Index n2) { previous = (i == 0) ? n0 : (i == 1) ? n1 : n2; });
+          if(previous == INULL<Index>) break;
+          visit_triplet(neighbors, previous, [&](Index n0, Index n1, Index n2) { i = (n0 == current) ? 1 : (n1 == current) ? 2 : 0; });
           current = previous;
      } while(current != t);
      t = current;
 
      do {
-          hpuint next;
+          Index next;
           visit(current);
-          visit_triplet(neighbors, current, [&](hpuint n0, hpuint n1, hpuint n2) { next = (i == 0) ? n2 : (i == 1) ? n0 : n1; });
-          if(!closed && next == UNULL) break;
-          visit_triplet(neighbors, next, [&](hpuint n0, hpuint n1, hpuint n2) { i = (n0 == current) ? 0 : (n1 == current) ? 1 : 2; });
+          visit_triplet(neighbors, current, [&](Index n0, Index n1, Index n2) { next = (i == 0) ? n2 : (i == 1) ? n0 : n1; });
+          if(!closed && next == INULL<Index>) break;
+          visit_triplet(neighbors, next, [&](Index n0, Index n1, Index n2) { i = (n0 == current) ? 0 : (n1 == current) ? 1 : 2; });
           current = next;
      } while(current != t);
 }
 
-template<class Visitor>
-void visit_fans(const Indices& neighbors, Visitor&& visit) {
+template<class Index, class Visitor>
+void visit_fans(const std::vector<Index>& neighbors, Visitor&& visit) {
      boost::dynamic_bitset<> visited(neighbors.size(), false);
 
-     auto update_visited = [&](hpuint current, hpuint next, hpuint n0, hpuint n1, hpuint n2) {
+     auto update_visited = [&](Index current, Index next, Index n0, Index n1, Index n2) {
           if(n0 == next) visited[3 * current + 1] = true;
           else if(n1 == next) visited[3 * current + 2] = true;
           else {
@@ -110,17 +177,18 @@ void visit_fans(const Indices& neighbors, Visitor&& visit) {
           }
      };
 
-     auto do_visit_fans = [&](hpuint t, hpuint i) {
-          std::vector<hpuint> fan;
-          visit_fan(neighbors, t, i, [&](hpuint n) { fan.push_back(n); });
+     std::vector<Index> fan;
+     auto do_visit_fans = [&](Index t, hpuint i) {
+          fan.clear();
+          visit_fan(neighbors, t, i, [&](Index n) { fan.push_back(n); });
           visit(t, i, fan);
           if(fan.size() == 1) return;
-          visit_pairs(fan.begin(), fan.size() - 1, 1, [&](hpuint current, hpuint next) {
-               visit_triplet(neighbors, current, [&](hpuint n0, hpuint n1, hpuint n2) { update_visited(current, next, n0, n1, n2); });
+          visit_pairs(fan.begin(), fan.size() - 1, 1, [&](Index current, Index next) {
+               visit_triplet(neighbors, current, [&](Index n0, Index n1, Index n2) { update_visited(current, next, n0, n1, n2); });
           });
           auto current = fan.back();
           auto next = fan.front();
-          visit_triplet(neighbors, current, [&](hpuint n0, hpuint n1, hpuint n2) { if(n0 == next || n1 == next || n2 == next) update_visited(current, next, n0, n1, n2); });
+          visit_triplet(neighbors, current, [&](Index n0, Index n1, Index n2) { if(n0 == next || n1 == next || n2 == next) update_visited(current, next, n0, n1, n2); });
      };
 
      for(auto t = 0lu, end = neighbors.size() / 3; t != end; ++t) {
@@ -131,16 +199,16 @@ void visit_fans(const Indices& neighbors, Visitor&& visit) {
 }
 
 
-template<class Visitor>
-void visit_edges(const Indices& neighbors, Visitor&& visit) {
+template<class Index, class Visitor>
+void visit_edges(const std::vector<Index>& neighbors, Visitor&& visit) {
      //TODO SM
      boost::dynamic_bitset<> visited(neighbors.size(), false);
 
-     auto do_visit_edge = [&](hpuint t, hpuint i) {
-          hpuint nt = neighbors[3 * t + i]; //neighboring triangle
-          if(nt != UNULL) {
+     auto do_visit_edge = [&](Index t, hpuint i) {
+          Index nt = neighbors[3 * t + i]; //neighboring triangle
+          if(nt != INULL<Index>) {
                hpuint ni;
-               visit_triplet(neighbors, nt, [&](hpuint n0, hpuint n1, hpuint n2) { ni = (n0 == t) ? 0 : (n1 == t) ? 1 : 2; });
+               visit_triplet(neighbors, nt, [&](Index n0, Index n1, Index n2) { ni = (n0 == t) ? 0 : (n1 == t) ? 1 : 2; });
                visited[3 * nt + ni] = true;
           }
           visit(t, i);
@@ -157,18 +225,18 @@ template<class Visitor>
 void visit_spokes(const std::vector<Edge>& edges, hpuint begin, Visitor&& visit) {
      auto e = begin;
      do {
-          auto& edge = edges[e];
-          visit(edge);
-          e = edges[edges[edge.next].next].opposite;
+          visit(edges[e]);
+          e = edges[edges[e].previous].opposite;//NOTE: The visitor may modify the edges and invalidate references.
      } while(e != begin);
 }
 
 template<class Visitor>
 void visit_fans(const std::vector<Edge>& edges, Visitor&& visit) {
      boost::dynamic_bitset<> visited(edges.size(), false);
+     std::vector<hpuint> triangles;
      for(auto begin = 0lu, end = edges.size(); begin < end; ++begin) {
           if(visited[begin]) continue;
-          std::vector<hpuint> triangles;
+          triangles.clear();
           visit_spokes(edges, begin, [&](const Edge& edge) {
                triangles.emplace_back(edge.next / 3);
                visited[edge.previous] = true;
@@ -179,8 +247,9 @@ void visit_fans(const std::vector<Edge>& edges, Visitor&& visit) {
 
 template<class Visitor>
 void visit_fans(const std::vector<Edge>& edges, const std::vector<hpuint>& outgoing, Visitor&& visit) {
+     std::vector<hpuint> triangles;
      for(auto begin : outgoing) {
-          std::vector<hpuint> triangles;
+          triangles.clear();
           visit_spokes(edges, begin, [&](const Edge& edge) { triangles.emplace_back(edge.next / 3); });
           visit(triangles.begin(), triangles.end());
      }
@@ -192,9 +261,10 @@ void visit_ring(const std::vector<Edge>& edges, hpuint begin, Visitor&& visit) {
 template<class Visitor>
 void visit_rings(const std::vector<Edge>& edges, Visitor&& visit) {
      boost::dynamic_bitset<> visited(edges.size(), false);
+     std::vector<hpuint> vertices;
      for(auto begin = 0lu, end = edges.size(); begin < end; ++begin) {
           if(visited[begin]) continue;
-          std::vector<hpuint> vertices;
+          vertices.clear();
           visit_spokes(edges, begin, [&](const Edge& edge) {
                vertices.emplace_back(edge.vertex);
                visited[edge.previous] = true;
@@ -205,8 +275,9 @@ void visit_rings(const std::vector<Edge>& edges, Visitor&& visit) {
 
 template<class Visitor>
 void visit_rings(const std::vector<Edge>& edges, const std::vector<hpuint>& outgoing, Visitor&& visit) {
+     std::vector<hpuint> vertices;
      for(auto begin : outgoing) {
-          std::vector<hpuint> vertices;
+          vertices.clear();
           visit_spokes(edges, begin, [&](const Edge& edge) { vertices.emplace_back(edge.vertex); });
           visit(vertices.begin(), vertices.end());
      }
@@ -229,7 +300,7 @@ class TriangleMesh<Vertex, Format::DIRECTED_EDGE> : public Geometry2D<typename V
 public:
      //NOTE: Indices all have to be arranged counterclockwise.
      TriangleMesh(Vertices vertices, Indices indices)
-          : Geometry2D<Space>(), Mesh<Vertex>(std::move(vertices), std::move(indices)), m_edges(make_edges(this->m_indices)), m_outgoing(this->m_vertices.size(), -1) { std::for_each(m_edges.begin(), m_edges.begin() + this->m_indices.size(), [&](const Edge& edge) { m_outgoing[edge.vertex] = edge.opposite; }); }
+          : Geometry2D<Space>(), Mesh<Vertex>(std::move(vertices), std::move(indices)), m_edges(make_edges(this->m_indices)), m_outgoing(this->m_vertices.size(), -1), m_staged(UNULL) { std::for_each(m_edges.begin(), m_edges.begin() + this->m_indices.size(), [&](const Edge& edge) { m_outgoing[edge.vertex] = edge.opposite; }); }
 
      template<Format format>
      TriangleMesh(const TriangleMesh<Vertex, format>& mesh)
@@ -239,8 +310,62 @@ public:
      TriangleMesh(TriangleMesh<Vertex, format>&& mesh)
           : TriangleMesh(std::move(mesh.getVertices()), std::move(mesh.getIndices())) {}
 
+     //NOTE: Splits issued between beginTransaction and commitTransaction append their edges after the border edges; the border edges are moved behind the new interior edges once, when the transaction is committed.  Edge indices of new edges and border edges obtained during a transaction are invalid after the commit.
+     void beginTransaction() {
+          assert(m_staged == UNULL);
+          m_border = this->m_indices.size();
+          m_staged = m_edges.size();
+     }
+
+     void commitTransaction() {
+          assert(m_staged != UNULL);
+          hpuint nBorder = m_staged - m_border;
+          hpuint nStaged = m_edges.size() - m_staged;
+          if(nBorder > 0 && nStaged > 0) {
+               auto remap = [&](hpuint e) -> hpuint { return (e < m_border) ? e : (e < m_staged) ? e + nStaged : e - nBorder; };
+               std::vector<std::pair<hpuint, hpuint> > moves;
+               moves.reserve(nBorder + m_pending.moves.size());
+               for(auto e = m_staged; e != m_border; --e) moves.emplace_back(e - 1, e - 1 + nStaged);
+               for(auto& move : m_pending.moves) moves.emplace_back(remap(move.first), remap(move.second));
+               m_pending.moves = std::move(moves);
+               for(auto& e : m_pending.edges) e = remap(e);
+               std::vector<std::pair<hpuint, hpuint> > outgoing;
+               for(auto e = m_border, end = hpuint(m_edges.size()); e != end; ++e) {
+                    auto& edge = m_edges[e];
+                    auto v = m_edges[edge.previous].vertex;
+                    if(m_outgoing[v] == e) outgoing.emplace_back(v, remap(e));
+                    if(edge.opposite < m_border) {
+                         m_edges[edge.opposite].opposite = remap(e);
+                         m_pending.edges.push_back(edge.opposite);
+                    }
+                    if(e < m_staged) m_pending.edges.push_back(remap(e));
+               }
+               for(auto i = m_edges.begin() + m_border, end = m_edges.end(); i != end; ++i) {
+                    auto& edge = *i;
+                    edge.next = remap(edge.next);
+                    edge.opposite = remap(edge.opposite);
+                    edge.previous = remap(edge.previous);
+               }
+               std::rotate(m_edges.begin() + m_border, m_edges.begin() + m_staged, m_edges.end());
+               for(auto& v : outgoing) m_outgoing[v.first] = v.second;
+          }
+          m_staged = UNULL;
+          if(nStaged == 0) return;
+          auto unique = [](Indices& indices) {
+               std::sort(indices.begin(), indices.end());
+               indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+          };
+          unique(m_pending.edges);
+          unique(m_pending.triangles);
+          unique(m_pending.vertices);
+          this->addChanges(std::move(m_pending));
+          m_pending = MeshChanges();
+     }
+
      template<class Iterator>
      void exsect(Iterator begin, Iterator end)  {
+          auto transaction = (m_staged == UNULL);
+          if(transaction) beginTransaction();
           --end;
           while(++begin != end) {
                auto i = m_outgoing[*begin];
@@ -258,6 +383,7 @@ public:
                     i = m_edges[m_edges[m_edges[i].next].next].opposite;
                }
           }
+          if(transaction) commitTransaction();
      }
 
      const Edge& getEdge(hpuint e) const { return m_edges[e]; }
@@ -276,6 +402,49 @@ public:
 
      std::tuple<const Vertex&, const Vertex&, const Vertex&> getTriangle(hpuint t) const { return std::tie(this->m_vertices[3 * t], this->m_vertices[3 * t + 1], this->m_vertices[3 * t + 2]); }
 
+     //NOTE: Moves the vertices along a space-filling curve and the triangles into an order suited to a vertex cache of the given size.  Returns, for every vertex and every triangle, its new index.  The changes recorded so far are cleared because the indices they refer to are no longer valid.
+     std::tuple<Indices, Indices> reorder(hpuint cacheSize = 32) {
+          assert(m_staged == UNULL);
+          auto& indices = this->m_indices;
+          hpuint nEdges = indices.size();
+          hpuint nTriangles = nEdges / 3;
+          hpuint nVertices = this->m_vertices.size();
+
+          auto vertexOrder = make_vertex_order(this->m_vertices);
+          Indices vertexMap(nVertices);
+          cilk_for(hpuint v = 0; v < nVertices; ++v) vertexMap[vertexOrder[v]] = v;
+          Vertices vertices;
+          vertices.reserve(nVertices);
+          for(auto v : vertexOrder) vertices.push_back(this->m_vertices[v]);
+          cilk_for(hpuint i = 0; i < nEdges; ++i) indices[i] = vertexMap[indices[i]];
+
+          auto triangleOrder = make_triangle_order(indices, cacheSize);
+          Indices triangleMap(nTriangles);
+          cilk_for(hpuint t = 0; t < nTriangles; ++t) triangleMap[triangleOrder[t]] = t;
+          auto remap = [&](hpuint e) -> hpuint { return (e < nEdges) ? 3 * triangleMap[e / 3] + e % 3 : e; };
+
+          Indices temp(nEdges);
+          std::vector<Edge> edges(m_edges.size());
+          cilk_for(hpuint e = 0; e < edges.size(); ++e) {
+               auto f = (e < nEdges) ? 3 * triangleOrder[e / 3] + e % 3 : e;
+               auto& edge = m_edges[f];
+               edges[e] = Edge(vertexMap[edge.vertex], remap(edge.next), remap(edge.opposite), remap(edge.previous));
+               if(e < nEdges) temp[e] = indices[f];
+          }
+          Indices outgoing(nVertices);
+          cilk_for(hpuint v = 0; v < nVertices; ++v) outgoing[vertexMap[v]] = remap(m_outgoing[v]);
+
+          this->m_vertices = std::move(vertices);
+          indices = std::move(temp);
+          m_edges = std::move(edges);
+          m_outgoing = std::move(outgoing);
+          if(this->m_loops) for(auto& v : this->m_loops->data()) v = vertexMap[v];
+          this->m_changes.clear();
+          ++this->m_version;
+
+          return std::make_tuple(std::move(vertexMap), std::move(triangleMap));
+     }
+
 /**********************************************************************************
  * split edge
  *
@@ -301,12 +470,12 @@ public:
  *       ___    v0
  *         //  /||   \\
  *        //  / ||    \\
- *       //e2   ||n4   \\
+ *       //n1   ||n3   \\
  *      //      ||      \\
- *     //     n2|| /   e5\\ |
- *    //   n1   ||/  n5   \\|
+ *     //     n0|| /   n5\\ |
+ *    //   n2   ||/  n4   \\|
    v2 ==========vn========== v3
- *   /\\   n0  /||   n3   //
+ *   /\\   e2  /||   e5   //
  *  /  \\     / ||e1     //
  *      \\e4    ||      //
  *       \\   e0||   e3//
@@ -315,29 +484,27 @@ public:
  *              v1
  *
  **********************************************************************************/
-     //NOTE: This works only on absolute meshes.  For relative meshes need base.
+     //NOTE: This works only on absolute meshes.  For relative meshes need base.  Edges e2 and e5 keep their indices but move into the new triangles n0 and n3, respectively, so that edge 3t+i always belongs to triangle t.
      void splitEdge(hpuint edge, hpreal u = 0.5) {
-          auto border = this->m_indices.size();
+          auto transaction = (m_staged == UNULL);
+          if(transaction) beginTransaction();
+
           auto e0 = edge;
-          auto& edge0 = m_edges[e0];
-          assert(edge < border && edge0.opposite < border);//TODO: edge to split is border edge or opposite is border
-          auto e1 = edge0.opposite;
-          auto& edge1 = m_edges[e1];
-          auto e2 = edge0.next;
-          auto& edge2 = m_edges[e2];
-          auto e3 = edge1.next;
-          auto& edge3 = m_edges[e3];
-          auto e4 = edge2.next;
-          auto& edge4 = m_edges[e4];
-          auto e5 = edge3.next;
-          auto& edge5 = m_edges[e5];
-
-          auto v0 = edge0.vertex;
+          auto e1 = m_edges[e0].opposite;
+          assert(!isBorder(e0) && !isBorder(e1));//TODO: edge to split is border edge or opposite is border
+          auto e2 = m_edges[e0].next;
+          auto e3 = m_edges[e1].next;
+          auto e4 = m_edges[e0].previous;
+          auto e5 = m_edges[e1].previous;
+          auto o2 = m_edges[e2].opposite;
+          auto o5 = m_edges[e5].opposite;
+
+          auto v0 = m_edges[e0].vertex;
           auto& vertex0 = this->getVertex(v0);
-          auto v1 = edge1.vertex;
+          auto v1 = m_edges[e1].vertex;
           auto& vertex1 = this->getVertex(v1);
-          auto v2 = edge2.vertex;
-          auto v3 = edge3.vertex;
+          auto v2 = m_edges[e2].vertex;
+          auto v3 = m_edges[e3].vertex;
           hpuint vn = this->m_vertices.size();
           Vertex vertexn(vertex0);//TODO: improve; possibilities: vertex as parameter, VertexUtils::mix(v1,v2)
           vertexn.position = vertex0.position * u + vertex1.position * (1.0f - u);
@@ -345,51 +512,31 @@ public:
 
           hpuint n0 = m_edges.size(), n1 = n0 + 1, n2 = n1 + 1, n3 = n2 + 1, n4 = n3 + 1, n5 = n4 + 1;
 
-          edge0.next = n0;
-          edge0.vertex = vn;
-          edge1.previous = n3;
-          edge2.next = n1;
-          edge2.previous = n2;
-          edge3.next = n3;
-          edge4.previous = n0;
-          edge5.previous = n5;
-          edge5.next = n4;
-
-          if(border < m_edges.size()) {
-               for(auto i = m_edges.begin(), end = m_edges.end(); i != end; ++i) {
-                    Edge& temp = *i;
-                    if(temp.next >= border) temp.next += 6;
-                    if(temp.opposite >= border) temp.opposite += 6;
-                    if(temp.previous >= border) temp.previous += 6;
-               }
-          }
+          m_edges[e0] = Edge(vn, e2, e1, e4);
+          m_edges[e1] = Edge(v1, e3, e0, e5);
+          m_edges[e2] = Edge(v2, e4, n2, e0);
+          m_edges[e5] = Edge(vn, e1, n4, e3);
+          m_edges[o2].opposite = n1;
+          m_edges[o5].opposite = n5;
 
-          Edge edges[] = { Edge(v2, e4, n1, e0), Edge(vn, n2, n0, e2), Edge(v0, e2, n4, n1), Edge(vn, e1, n5, e3), Edge(vn, n5, n2, e5), Edge(v3, e5, n3, n4) };
-          m_edges.insert(m_edges.begin() + border, edges, edges + 6);
-
-          hpuint found = 0;
-          for(auto i = this->m_indices.begin(), end = this->m_indices.end(); i != end; ++i) {//TODO: replace with simd
-               auto j = i;
-               hpuint u0 = *i;
-               hpuint u1 = *(++i);
-               hpuint u2 = *(++i);
-               if((u0 == v0 && u1 == v2 && u2 == v1) || (u0 == v2 && u1 == v1 && u2 == v0) || (u0 == v1 && u1 == v0 && u2 == v2)) {
-                    *j = vn;
-                    *(++j) = v2;
-                    *(++j) = v1;
-                    if((++found) == 2) break;
-               } else if((u0 == v0 && u1 == v1 && u2 == v3) || (u0 == v1 && u1 == v3 && u2 == v0) || (u0 == v3 && u1 == v0 && u2 == v1)) {
-                    *j = vn;
-                    *(++j) = v1;
-                    *(++j) = v3;
-                    if((++found) == 2) break;
-               }
-          }
-          hpuint indices[] = { vn, v0, v2, vn, v3, v0 };
+          Edge edges[] = { Edge(v0, n1, n3, n2), Edge(v2, n2, o2, n0), Edge(vn, n0, e2, n1), Edge(vn, n4, n0, n5), Edge(v3, n5, e5, n3), Edge(v0, n3, o5, n4) };
+          m_edges.insert(m_edges.end(), edges, edges + 6);
+
+          this->m_indices[getIndex(e1)] = vn;
+          this->m_indices[getIndex(e2)] = vn;
+          hpuint indices[] = { vn, v0, v2, v0, vn, v3 };
           this->m_indices.insert(this->m_indices.end(), indices, indices + 6);
 
-          m_outgoing[v0] = n4;
-          m_outgoing.push_back(n2);
+          if(m_outgoing[v0] == e1 || m_outgoing[v0] == e2) m_outgoing[v0] = n3;
+          m_outgoing.push_back(n0);
+
+          hpuint t = this->m_indices.size() / 3 - 2;
+          m_pending.edges.insert(m_pending.edges.end(), { e0, e1, e2, e5, o2, o5, n0, n1, n2, n3, n4, n5 });
+          m_pending.moves.insert(m_pending.moves.end(), { { e2, n1 }, { e5, n5 } });
+          m_pending.triangles.insert(m_pending.triangles.end(), { getIndex(e1) / 3, getIndex(e2) / 3, t, t + 1 });
+          m_pending.vertices.insert(m_pending.vertices.end(), { v0, v1, v2, v3, vn });
+
+          if(transaction) commitTransaction();
      }
 
 /**********************************************************************************
@@ -407,20 +554,20 @@ public:
  *
  *
  *                    AFTER
- *               ___    v1
+ *               ___    v2
  *                 //  /||   \\
  *                //  / ||    \\
  *               //     ||     \\
- *              //    g2||f1    \\
- *             //       || /     \\ |
+ *              //    n5||n1    \\
+ *             //n3     || /   n0\\ |
  *            //        ||/       \\|
  *           //         vn         \\
- *          //e2       //\\       e1\\
+ *          //         //\\         \\
  *         //        //    \\        \\
  *        //       //        \\       \\
  *       //      //            \\      \\
- *      //   f2//                \\g1   \\
- *     //    //g0                f0\\    \\
+ *      //   n4//                \\n2   \\
+ *     //    //e2                e1\\    \\
  *    //   //                        \\   \\
  *   //  //                            \\  \\
  *  // //                                \\ \\
@@ -428,8 +575,11 @@ public:
  * v0 ====================================== v1
  *
  **********************************************************************************/
+     //NOTE: Edges e1 and e2 keep their indices but are moved to the new triangles n0 and n3, respectively, so that edge 3t+i always belongs to triangle t.
      void splitTriangle(hpuint triangle, hpreal u = 1.0/3.0, hpreal v = 1.0/3.0) {
-          auto border = this->m_indices.size();
+          auto transaction = (m_staged == UNULL);
+          if(transaction) beginTransaction();
+
           auto offset = 3 * triangle;
           auto i = this->m_indices.cbegin() + offset;
           auto v0 = *i;
@@ -440,47 +590,140 @@ public:
           auto& vertex2 = this->getVertex(v2);
           hpuint vn = this->m_vertices.size();
 
-          auto e0 = *getEdgeIndex(v0, v1);
-          auto& edge0 = m_edges[e0];
-          auto e1 = edge0.next;
-          auto& edge1 = m_edges[e1];
-          auto e2 = edge1.next;
-          auto& edge2 = m_edges[e2];
-          hpuint f0 = m_edges.size(), g0 = f0 + 1, f1 = g0 + 1, g1 = f1 + 1, f2 = g1 + 1, g2 = f2 + 1;
+          auto e0 = getEdgeIndex(triangle);
+          auto e1 = e0 + 1;
+          auto e2 = e0 + 2;
+          auto o1 = m_edges[e1].opposite;
+          auto o2 = m_edges[e2].opposite;
+          hpuint n0 = m_edges.size(), n1 = n0 + 1, n2 = n1 + 1, n3 = n2 + 1, n4 = n3 + 1, n5 = n4 + 1;
 
           Vertex vertexn(vertex0);//TODO: improve; possibilities: vertex as parameter, VertexUtils::mix(v1,v2)
           vertexn.position = vertex0.position * u + vertex1.position * v + vertex2.position * (1.0f - u - v);
           this->m_vertices.push_back(vertexn);
-          m_outgoing.push_back(g0);
-
-          if(border < m_edges.size()) {//TODO: refactor into method insertEdges
-               for(auto& edge : m_edges) {
-                    if(edge.next >= border) edge.next += 6;
-                    if(edge.opposite >= border) edge.opposite += 6;
-                    if(edge.previous >= border) edge.previous += 6;
-               }
-          }
 
-          edge0.next = f0;
-          edge0.previous = g0;
-          edge1.next = f1;
-          edge1.previous = g1;
-          edge2.next = f2;
-          edge2.previous = g2;
+          m_edges[e1] = Edge(vn, e2, n2, e0);
+          m_edges[e2] = Edge(v0, e0, n4, e1);
+          m_edges[o1].opposite = n0;
+          m_edges[o2].opposite = n3;
 
-          Edge edges[] = { Edge(vn, g0, g1, e0), Edge(v0, e0, f2, f0), Edge(vn, g1, g2, e1), Edge(v1, e1, f0, f1), Edge(vn, g2, g0, e2), Edge(v2, e2, f1, f2) };
-          m_edges.insert(m_edges.begin() + border, edges, edges + 6);
+          Edge edges[] = { Edge(v2, n1, o1, n2), Edge(vn, n2, n5, n0), Edge(v1, n0, e1, n1), Edge(v0, n4, o2, n5), Edge(vn, n5, e2, n3), Edge(v2, n3, n1, n4) };
+          m_edges.insert(m_edges.end(), edges, edges + 6);
 
           this->m_indices[offset + 2] = vn;
-          hpuint indices[] = { vn, v1, v2, vn, v2, v0 };
+          hpuint indices[] = { v1, v2, vn, v2, v0, vn };
           this->m_indices.insert(this->m_indices.end(), indices, indices + 6);
 
-          //TODO: if triangle or edges are split and there are caches, caches must be updated
+          if(m_outgoing[v1] == e1) m_outgoing[v1] = n0;
+          if(m_outgoing[v2] == e2) m_outgoing[v2] = n3;
+          m_outgoing.push_back(e2);
+
+          hpuint t = this->m_indices.size() / 3 - 2;
+          m_pending.edges.insert(m_pending.edges.end(), { e1, e2, o1, o2, n0, n1, n2, n3, n4, n5 });
+          m_pending.moves.insert(m_pending.moves.end(), { { e1, n0 }, { e2, n3 } });
+          m_pending.triangles.insert(m_pending.triangles.end(), { triangle, t, t + 1 });
+          m_pending.vertices.insert(m_pending.vertices.end(), { v0, v1, v2, vn });
+
+          if(transaction) commitTransaction();
      }
 
 private:
+     hpuint m_border;//NOTE: Index of the first border edge while a transaction is open.
      std::vector<Edge> m_edges;
      std::vector<hpuint> m_outgoing;
+     MeshChanges m_pending;//NOTE: Changes made during the open transaction.
+     hpuint m_staged;//NOTE: Index of the first edge added during the open transaction or UNULL if there is no open transaction.
+
+     //NOTE: Returns the index of the first edge of the given triangle, taking into account that, during a transaction, edges of new triangles are staged after the border edges.
+     hpuint getEdgeIndex(hpuint triangle) const {
+          auto e = 3 * triangle;
+          return (m_staged == UNULL || e < m_border) ? e : m_staged + (e - m_border);
+     }
+
+     //NOTE: Returns the position in the indices of the source vertex of the given nonborder edge.
+     hpuint getIndex(hpuint edge) const { return (m_staged == UNULL || edge < m_border) ? edge : m_border + (edge - m_staged); }
+
+     bool isBorder(hpuint edge) const { return (m_staged == UNULL) ? edge >= this->m_indices.size() : (m_border <= edge && edge < m_staged); }
+
+};//TriangleMesh
+
+/*
+ * @section DESCRIPTION
+ *
+ * A compact edge mesh stores only the opposite of every edge.  The next and the
+ * previous edge of an edge as well as the vertex it points to follow from the
+ * indices because edge 3t+i runs from the ith to the (i+1)th vertex of triangle t.
+ * The border edges, which are numbered after the interior edges, are kept in a
+ * separate table.  Edges are returned by value.
+ */
+template<class Vertex>
+class TriangleMesh<Vertex, Format::COMPACT_EDGE> : public Geometry2D<typename Vertex::SPACE>, public Mesh<Vertex> {
+     using Space = typename Vertex::SPACE;
+     using Vertices = typename Mesh<Vertex>::Vertices;
+
+public:
+     //NOTE: Indices all have to be arranged counterclockwise.
+     TriangleMesh(Vertices vertices, Indices indices)
+          : Geometry2D<Space>(), Mesh<Vertex>(std::move(vertices), std::move(indices)), m_opposites(make_opposites(this->m_indices)), m_outgoing(this->m_vertices.size(), -1) {
+          m_border = make_border_edges(this->m_indices, m_opposites);
+          for(hpuint e = 0, end = this->m_indices.size(); e < end; ++e) m_outgoing[this->m_indices[getNext(e)]] = m_opposites[e];
+     }
+
+     template<Format format>
+     TriangleMesh(const TriangleMesh<Vertex, format>& mesh)
+          : TriangleMesh(mesh.getVertices(), mesh.getIndices()) {}
+
+     template<Format format>
+     TriangleMesh(TriangleMesh<Vertex, format>&& mesh)
+          : TriangleMesh(std::move(mesh.getVertices()), std::move(mesh.getIndices())) {}
+
+     const std::vector<Edge>& getBorder() const { return m_border; }
+
+     Edge getEdge(hpuint e) const {
+          if(isBorder(e)) return m_border[e - this->m_indices.size()];
+          auto next = getNext(e);
+          return { this->m_indices[next], next, m_opposites[e], getPrevious(e) };
+     }
+
+     boost::optional<hpuint> getEdgeIndex(hpuint v0, hpuint v1) const {
+          auto begin = m_outgoing[v0];
+          auto e = begin;
+          do {
+               if(getEdge(e).vertex == v1) return e;
+               e = getOpposite(getPrevious(e));
+          } while(e != begin);
+          return boost::none;
+     }
+
+     hpuint getNext(hpuint e) const {
+          if(isBorder(e)) return m_border[e - this->m_indices.size()].next;
+          auto t = e - e % 3;
+          return t + (e - t + 1) % 3;
+     }
+
+     hpuint getNumberOfEdges() const { return this->m_indices.size() + m_border.size(); }
+
+     hpuint getNumberOfTriangles() const { return this->m_indices.size() / 3; }
+
+     hpuint getOpposite(hpuint e) const { return isBorder(e) ? m_border[e - this->m_indices.size()].opposite : m_opposites[e]; }
+
+     const Indices& getOpposites() const { return m_opposites; }
+
+     const std::vector<hpuint>& getOutgoing() const { return m_outgoing; }
+
+     hpuint getOutgoing(hpuint v) const { return m_outgoing[v]; }
+
+     hpuint getPrevious(hpuint e) const {
+          if(isBorder(e)) return m_border[e - this->m_indices.size()].previous;
+          auto t = e - e % 3;
+          return t + (e - t + 2) % 3;
+     }
+
+     bool isBorder(hpuint e) const { return e >= this->m_indices.size(); }
+
+private:
+     std::vector<Edge> m_border;
+     Indices m_opposites;
+     std::vector<hpuint> m_outgoing;
 
 };//TriangleMesh
 
@@ -490,16 +733,62 @@ struct is_triangle_mesh : public std::false_type {};
 template<class Mesh, class Space, class Vertex>
 struct is_triangle_mesh<Mesh, Space, Vertex, typename std::enable_if<std::is_base_of<TriangleMesh<Vertex>, Mesh>::value && std::is_base_of<typename Mesh::SPACE, Space>::value>::type> : public std::true_type {};
 
-template<class Vertex, Format t_format = Format::SIMPLE>
-static TriangleMesh<Vertex, t_format> make_triangle_mesh(std::vector<Vertex> vertices, std::vector<hpuint> indices) { return { std::move(vertices), std::move(indices) }; }
+template<class Vertex, Format t_format = Format::SIMPLE, class Index>
+static TriangleMesh<Vertex, t_format, HeapStorage, Index> make_triangle_mesh(std::vector<Vertex> vertices, std::vector<Index> indices) { return { std::move(vertices), std::move(indices) }; }
+
+//NOTE: A mapped triangle mesh file starts with this header, which is followed by the vertices and then by the indices, each in their in-memory representation.
+struct MappedTriangleMeshHeader {
+     static constexpr std::uint64_t MAGIC = 0x48504d4150544d31;//NOTE: "HPMAPTM1"
+
+     std::uint64_t magic;
+     std::uint64_t indexSize;
+     std::uint64_t nIndices;
+     std::uint64_t nVertices;
+     std::uint64_t vertexSize;
+
+};//MappedTriangleMeshHeader
+
+//NOTE: Maps a file written by write_mapped into memory.  The vertices and indices are paged in by the operating system when they are accessed; the mesh is read-only.
+template<class Vertex, class Index = hpuint>
+TriangleMesh<Vertex, Format::SIMPLE, MappedStorage, Index> make_mapped_triangle_mesh(const std::string& path) {
+     using Header = MappedTriangleMeshHeader;
+
+     auto file = std::make_shared<typename MappedArray<Vertex>::File>(path);
+     if(file->size() < sizeof(Header)) throw std::runtime_error("File is not a mapped triangle mesh.");
+     auto& header = *reinterpret_cast<const Header*>(file->data());
+     if(header.magic != Header::MAGIC) throw std::runtime_error("File is not a mapped triangle mesh.");
+     if(header.vertexSize != sizeof(Vertex)) throw std::runtime_error("Vertex type does not match the vertices in the file.");
+     if(header.indexSize != sizeof(Index)) throw std::runtime_error("Index type does not match the indices in the file.");
+     auto offset = sizeof(Header) + header.nVertices * sizeof(Vertex);
+     if(file->size() < offset + header.nIndices * sizeof(Index)) throw std::runtime_error("File is truncated.");
+     return { { file, sizeof(Header), header.nVertices }, { file, offset, header.nIndices } };
+}
+
+template<class Vertex, Format format, class Storage, class Index>
+void write_mapped(const TriangleMesh<Vertex, format, Storage, Index>& mesh, const std::string& path) {
+     static_assert(std::is_trivially_copyable<Vertex>::value, "Only trivially copyable vertices can be mapped into memory.");
+     static_assert(sizeof(Vertex) % sizeof(Index) == 0, "The indices following the vertices would not be aligned.");
+     using Header = MappedTriangleMeshHeader;
+
+     auto& indices = mesh.getIndices();
+     auto& vertices = mesh.getVertices();
+     std::ofstream out(path, std::ios::binary);
+     if(out.fail()) throw std::runtime_error("Failed to open file.");
+     Header header = { Header::MAGIC, sizeof(Index), indices.size(), vertices.size(), sizeof(Vertex) };
+     out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+     out.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(Vertex));
+     out.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(Index));
+     if(out.fail()) throw std::runtime_error("Failed to write file.");
+}
 
 template<class Vertex, class Visitor>
 void visit_spokes(const TriangleMesh<Vertex, Format::DIRECTED_EDGE>& mesh, hpuint begin, Visitor&& visit) { visit_spokes(mesh.getEdges(), begin, std::forward<Visitor>(visit)); }
 
 template<class Vertex, class Visitor>
 void visit_fans(const TriangleMesh<Vertex, Format::DIRECTED_EDGE>& mesh, Visitor&& visit) {
+     std::vector<Vertex> triangles;
      for(auto begin : mesh.getOutgoing()) {
-          std::vector<Vertex> triangles;
+          triangles.clear();
           visit_spokes(mesh.getEdges(), begin, [&](const Edge& edge) {
                auto triangle = mesh.getTriangle(edge.next / 3);
                triangles.emplace_back(std::get<0>(triangle));
@@ -510,18 +799,91 @@ void visit_fans(const TriangleMesh<Vertex, Format::DIRECTED_EDGE>& mesh, Visitor
      }
 }
 
+template<class Vertex>
+std::tuple<Indices, Indices> make_fans(const TriangleMesh<Vertex, Format::DIRECTED_EDGE>& mesh) { return make_fans(mesh.getEdges(), mesh.getOutgoing(), mesh.getIndices().size()); }
+
+template<class Vertex>
+std::tuple<Indices, Indices> make_rings(const TriangleMesh<Vertex, Format::DIRECTED_EDGE>& mesh) { return make_rings(mesh.getEdges(), mesh.getOutgoing()); }
+
 template<class Vertex, class Visitor>
 void visit_ring(const TriangleMesh<Vertex, Format::DIRECTED_EDGE>& mesh, hpuint v, Visitor&& visit) { visit_spokes(mesh.getEdges(), mesh.getOutgoing(v), [&](const Edge& edge) { visit(mesh.getVertex(edge.vertex)); }); }
 
 template<class Vertex, class Visitor>
 void visit_rings(const TriangleMesh<Vertex, Format::DIRECTED_EDGE>& mesh, Visitor&& visit) {
+     std::vector<Vertex> vertices;
      for(auto begin : mesh.getOutgoing()) {
-          std::vector<Vertex> vertices;
+          vertices.clear();
           visit_spokes(mesh.getEdges(), begin, [&](const Edge& edge) { vertices.emplace_back(mesh.getVertex(edge.vertex)); });
           visit(vertices.begin(), vertices.end());
      }
 }
 
+template<class Vertex, class Visitor>
+void visit_spokes(const TriangleMesh<Vertex, Format::COMPACT_EDGE>& mesh, hpuint begin, Visitor&& visit) {
+     auto e = begin;
+     do {
+          visit(mesh.getEdge(e));
+          e = mesh.getOpposite(mesh.getPrevious(e));
+     } while(e != begin);
+}
+
+template<class Vertex, class Visitor>
+void visit_ring(const TriangleMesh<Vertex, Format::COMPACT_EDGE>& mesh, hpuint v, Visitor&& visit) { visit_spokes(mesh, mesh.getOutgoing(v), [&](const Edge& edge) { visit(mesh.getVertex(edge.vertex)); }); }
+
+template<class Vertex, class Visitor>
+void visit_rings(const TriangleMesh<Vertex, Format::COMPACT_EDGE>& mesh, Visitor&& visit) {
+     std::vector<Vertex> vertices;
+     for(auto begin : mesh.getOutgoing()) {
+          vertices.clear();
+          visit_spokes(mesh, begin, [&](const Edge& edge) { vertices.emplace_back(mesh.getVertex(edge.vertex)); });
+          visit(vertices.begin(), vertices.end());
+     }
+}
+
+template<class Vertex>
+hpuint get_degree(const TriangleMesh<Vertex, Format::COMPACT_EDGE>& mesh, hpuint v) {
+     auto degree = 0u;
+     visit_spokes(mesh, mesh.getOutgoing(v), [&](const Edge& edge) { ++degree; });
+     return degree;
+}
+
+//NOTE: Updates neighbors as returned by make_neighbors(mesh.getIndices()) after the given changes.
+template<class Vertex>
+void update_neighbors(const TriangleMesh<Vertex, Format::DIRECTED_EDGE>& mesh, const MeshChanges& changes, Indices& neighbors) {
+     auto n = mesh.getIndices().size();
+     neighbors.resize(n, UNULL);
+     for(auto e : changes.edges) if(e < n) {
+          auto o = mesh.getEdge(e).opposite;
+          neighbors[e] = (o < n) ? o / 3 : UNULL;
+     }
+}
+
+//NOTE: Recomputes the averaged normals of the vertices that were added or whose one-ring changed; see TriangleMeshUtils::computeAveragedNormals.
+template<class Vertex>
+void update_normals(TriangleMesh<Vertex, Format::DIRECTED_EDGE>& mesh, const MeshChanges& changes) {
+     static_assert(contains_normal<Vertex>::value, "The computation of normals makes sense only for vertices that contain normals.");
+     using Vector = typename Vertex::SPACE::VECTOR;
+
+     auto& edges = mesh.getEdges();
+     auto& indices = mesh.getIndices();
+     auto& vertices = mesh.getVertices();
+     hpuint border = indices.size();
+     cilk_for(hpuint i = 0; i < changes.vertices.size(); ++i) {
+          auto v = changes.vertices[i];
+          Vector normal(0);
+          visit_spokes(edges, mesh.getOutgoing(v), [&](const Edge& edge) {
+               if(edge.next >= border) return;
+               auto t = edge.next / 3;
+               auto& p0 = vertices[indices[3 * t]].position;
+               auto& p1 = vertices[indices[3 * t + 1]].position;
+               auto& p2 = vertices[indices[3 * t + 2]].position;
+               normal += glm::cross(p1 - p0, p2 - p0);
+          });
+          auto length = glm::length(normal);
+          if(length > 0) vertices[v].normal = normal / length;
+     }
+}
+
 template<class Vertex>
 hpuint get_degree(const TriangleMesh<Vertex, Format::DIRECTED_EDGE>& mesh, hpuint v) {
      auto degree = 0u;
@@ -5,6 +5,9 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cilk/cilk.h>
+#include <numeric>
 #include <tuple>
 #include <vector>
 
@@ -15,10 +18,32 @@ namespace happah {
 
 class TriangleMeshUtils {
 public:
+     //NOTE: The normals of the triangles are weighted by their areas.  The normals of the triangles around every vertex are gathered instead of the normal of every triangle being scattered to its three vertices so that no two strands ever write to the same vertex.
      template<class Vertex>
      static void computeAveragedNormals(std::vector<Vertex>& vertices, const std::vector<hpuint>& indices) {
           static_assert(contains_normal<Vertex>::value, "The computation of normals makes sense only for vertices that contain normals.");
-          //TODO
+          using Vector = typename Vertex::SPACE::VECTOR;
+
+          hpuint nTriangles = indices.size() / 3;
+          hpuint nVertices = vertices.size();
+
+          auto normals = computeTriangleNormals(vertices, indices);
+
+          Indices offsets(nVertices + 1, 0);
+          for(auto v : indices) ++offsets[v + 1];
+          std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+          Indices fans(indices.size());
+          {
+               Indices cursors(offsets.begin(), offsets.end() - 1);
+               for(hpuint i = 0, end = indices.size(); i < end; ++i) fans[cursors[indices[i]]++] = i / 3;
+          }
+
+          cilk_for(hpuint v = 0; v < nVertices; ++v) {
+               Vector normal(0);
+               for(auto i = offsets[v], end = offsets[v + 1]; i < end; ++i) normal += normals[fans[i]];
+               auto length = glm::length(normal);
+               if(length > 0) vertices[v].normal = normal / length;
+          }
      }
 
      //TODO: even better deindexedarray iterator or something like that
@@ -27,12 +52,48 @@ public:
      static void computeFlatNormals(std::vector<Vertex>& vertices, const std::vector<hpuint>& indices) {
           static_assert(contains_normal<Vertex>::value, "The computation of normals makes sense only for vertices that contain normals.");
           
-          for(auto i = indices.cbegin(), end = indices.cend(); i != end; ++i) {
-               Vertex& v0 = vertices[*i];
-               Vertex& v1 = vertices[*(++i)];
-               Vertex& v2 = vertices[*(++i)];
-               v2.normal = glm::cross(v1.position - v0.position, v2.position - v0.position);
+          hpuint nTriangles = indices.size() / 3;
+          hpuint nVertices = vertices.size();
+
+          //NOTE: A vertex that provokes several triangles takes the normal of the last one.  The owners are found serially so that every vertex is written by exactly one strand.
+          auto normals = computeTriangleNormals(vertices, indices);
+          Indices owners(nVertices, UNULL);
+          for(hpuint t = 0; t < nTriangles; ++t) owners[indices[3 * t + 2]] = t;
+          cilk_for(hpuint v = 0; v < nVertices; ++v) if(owners[v] != UNULL) vertices[v].normal = normals[owners[v]];
+     }
+
+     //NOTE: The normals of the triangles, weighted by their areas.  The positions of blocks of N_LANES triangles are gathered into one array per coordinate so that the cross products of a block are computed in SIMD lanes.
+     template<class Vertex>
+     static std::vector<typename Vertex::SPACE::VECTOR> computeTriangleNormals(const std::vector<Vertex>& vertices, const std::vector<hpuint>& indices) {
+          using Vector = typename Vertex::SPACE::VECTOR;
+          static constexpr hpuint N_LANES = 8;
+
+          hpuint nTriangles = indices.size() / 3;
+          hpuint nBlocks = (nTriangles + N_LANES - 1) / N_LANES;
+          std::vector<Vector> normals(nTriangles);
+          cilk_for(hpuint b = 0; b < nBlocks; ++b) {
+               hpuint begin = b * N_LANES;
+               hpuint nValid = std::min(N_LANES, nTriangles - begin);
+               hpreal p[3][3][N_LANES];//NOTE: Corner, coordinate, lane; unused lanes repeat the last triangle of the block.
+               hpreal n[3][N_LANES];
+               for(hpuint l = 0; l < N_LANES; ++l) {
+                    auto triangle = indices.data() + 3 * (begin + std::min(l, nValid - 1));
+                    for(hpuint i = 0; i < 3; ++i) {
+                         auto& position = vertices[triangle[i]].position;
+                         for(hpuint c = 0; c < 3; ++c) p[i][c][l] = position[c];
+                    }
+               }
+               #pragma simd
+               for(hpuint l = 0; l < N_LANES; ++l) {
+                    hpreal ax = p[1][0][l] - p[0][0][l], ay = p[1][1][l] - p[0][1][l], az = p[1][2][l] - p[0][2][l];
+                    hpreal bx = p[2][0][l] - p[0][0][l], by = p[2][1][l] - p[0][1][l], bz = p[2][2][l] - p[0][2][l];
+                    n[0][l] = ay * bz - az * by;
+                    n[1][l] = az * bx - ax * bz;
+                    n[2][l] = ax * by - ay * bx;
+               }
+               for(hpuint l = 0; l < nValid; ++l) normals[begin + l] = Vector(n[0][l], n[1][l], n[2][l]);
           }
+          return normals;
      }
 
      template<class Vertex, class Base>
@@ -38,7 +38,7 @@ class HexagonDecomposition {
           Mesh& m_mesh;
           Indices m_neighbors;
           boost::dynamic_bitset<> m_reverse;
-          std::set<hpuint> m_wallEdges;
+          std::set<std::pair<hpuint, hpuint> > m_wallEdges;//NOTE: Edges are stored as pairs of vertices because splits may move edges to other indices.
           std::set<hpuint> m_wallVertices;
           Weigher m_weigher;
 
@@ -64,9 +64,12 @@ class HexagonDecomposition {
                auto n = m_decomposition.m_neighbors.cbegin();
                for(hpuint hexagon = 0; hexagon < nHexagons; ++hexagon) {
                     auto center = m_decomposition.getCenter(hexagon);
+                    m_mesh.beginTransaction();
                     while(get_degree(m_mesh, center) < 6) {
-                         visit_spokes(m_mesh, center, [&](const Edge& edge) { if(m_wallEdges.find(edge.next) == m_wallEdges.end()) m_mesh.splitEdge(edge.next); });
+                         visit_spokes(m_mesh, m_mesh.getOutgoing(center), [&](const Edge& edge) { if(!isWallEdge(edge.vertex, m_mesh.getEdge(edge.next).vertex)) m_mesh.splitEdge(edge.next); });
                     }
+                    m_mesh.commitTransaction();
+                    m_weigher.update();
                     auto first = m_boundaries.size();
                     auto b5 = m_boundaries[*(i + 5)];
                     hpuint ep = (m_decomposition.m_reverse[6 * hexagon + 5]) ? *(b5.first + 1) : *(b5.second - 2);
@@ -115,7 +118,7 @@ class HexagonDecomposition {
                               continue;
                          }
                          m_mesh.exsect(temp.cbegin(), temp.cend());
-                         m_weigher.resize(m_mesh.getNumberOfEdges());//TODO: better m_weigher.handleMeshChangedEvent(m_mesh); or recreate weigher and shortest path finder
+                         m_weigher.update();
                          if(!shortestPathFinder.getShortestPath(center, e, m_wallVertices.cbegin(), m_wallVertices.cend(), IndicesArrays::ArrayAppender(m_boundaries))) {
                               std::cerr << "Failed to find path from center.\n";
                               continue;
@@ -134,29 +137,30 @@ class HexagonDecomposition {
           template<class Iterator>
           void extendWall(Iterator begin, Iterator end, bool loop = false) {
                for(auto i0 = begin, i1 = i0 + 1; i1 != end; i0 = i1, ++i1) {
-                    auto e = *m_mesh.getEdgeIndex(*i0, *i1);
-                    m_wallEdges.insert(e);
-                    m_wallEdges.insert(m_mesh.getEdge(e).opposite);
+                    m_wallEdges.insert(std::minmax(*i0, *i1));
                     m_wallVertices.insert(*i0);
                }
                if(loop) {
-                    auto e = *m_mesh.getEdgeIndex(*begin, *(end - 1));
-                    m_wallEdges.insert(e);
-                    m_wallEdges.insert(m_mesh.getEdge(e).opposite);
+                    m_wallEdges.insert(std::minmax(*begin, *(end - 1)));
                     m_wallVertices.insert(*(end - 1));
                }
           }
 
+          bool isWallEdge(hpuint v0, hpuint v1) const { return m_wallEdges.find(std::minmax(v0, v1)) != m_wallEdges.end(); }
+
           template<class Iterator>
           void splitDangerousEdges(Iterator begin, Iterator end) {
+               m_mesh.beginTransaction();
                do {
-                    visit_spokes(m_mesh, *begin, [&](const Edge& edge) {
-                         if(m_wallEdges.find(edge.opposite) != m_wallEdges.end()) return;
+                    auto v = *begin;
+                    visit_spokes(m_mesh, m_mesh.getOutgoing(v), [&](const Edge& edge) {
+                         if(isWallEdge(v, edge.vertex)) return;
                          if(m_wallVertices.find(edge.vertex) == m_wallVertices.end()) return;
                          m_mesh.splitEdge(edge.opposite);
                     });
                } while(++begin != end);
-               m_weigher.resize(m_mesh.getNumberOfEdges());
+               m_mesh.commitTransaction();
+               m_weigher.update();
           }
 
           TriangleDecomposition<Mesh> decompose() { return { m_decomposition.m_mesh, std::move(m_boundaries), std::move(m_indices), std::move(m_neighbors), std::move(m_reverse) }; }
@@ -7,11 +7,39 @@
 
 #include "happah/Happah.h"
 
+//NOTE: Binomials and multinomials of degree up to this are looked up in a table computed at compile time; the multinomials must fit into an hpuint.
+#ifndef HAPPAH_MAX_DEGREE
+#define HAPPAH_MAX_DEGREE 20
+#endif
+
 class MathUtils {
 public:
+     static constexpr hpuint MAX_DEGREE = HAPPAH_MAX_DEGREE;
+
+     //NOTE: Pascal's triangle; the ith binomial of degree n is values[n][i].
+     template<hpuint t_maxDegree>
+     struct BinomialTable {
+          hpuint values[t_maxDegree + 1][t_maxDegree + 1];
+
+          constexpr BinomialTable()
+               : values{} {
+               for(hpuint n = 0; n <= t_maxDegree; ++n) {
+                    values[n][0] = 1;
+                    for(hpuint i = 1; i <= n; ++i) values[n][i] = values[n - 1][i - 1] + ((i < n) ? values[n - 1][i] : 0);
+               }
+          }
+
+     };//BinomialTable
+
+     template<hpuint t_maxDegree = MAX_DEGREE>
+     struct get_binomials {
+          static constexpr BinomialTable<t_maxDegree> value{};
+     };
+
      template<bool t_check = true>
-     static hpuint binom(hpuint n, hpuint i) {
+     static constexpr hpuint binom(hpuint n, hpuint i) {
           if(t_check && i > n) return 0;
+          if(n <= MAX_DEGREE) return get_binomials<>::value.values[n][i];
           if(i == n) return 1;
           hpuint result = 1;
           for(hpuint d = 1; d <= i; ++d) {
@@ -22,8 +50,9 @@ public:
      }
 
      template<bool t_check = true>
-     static hpuint munom(hpuint n, hpuint i, hpuint j) {
+     static constexpr hpuint munom(hpuint n, hpuint i, hpuint j) {
           if(t_check && (i+j) > n) return 0;
+          if(n <= MAX_DEGREE) return get_binomials<>::value.values[n][i] * get_binomials<>::value.values[n - i][j];
           hpuint result = 1;
           for(hpuint d = 1; d <= i; ++d) {
                result *= n--;
@@ -36,7 +65,7 @@ public:
           return result;
      }
 
-     static hpreal pow(hpreal x, hpuint i) {
+     static constexpr hpreal pow(hpreal x, hpuint i) {
           if(i == 0) return 1;
           if(i == 1) return x;
           hpreal tmp = pow(x, (i >> 1));
@@ -46,3 +75,6 @@ public:
 
 };
 
+template<hpuint t_maxDegree>
+constexpr MathUtils::BinomialTable<t_maxDegree> MathUtils::get_binomials<t_maxDegree>::value;
+
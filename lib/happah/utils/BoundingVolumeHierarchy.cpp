@@ -0,0 +1,55 @@
+// Copyright 2017
+//   Pawel Herman - Karlsruhe Institute of Technology - pherman@ira.uka.de
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <numeric>
+
+#include "happah/utils/BoundingVolumeHierarchy.h"
+
+namespace happah {
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy(const std::vector<Point3D>& mins, const std::vector<Point3D>& maxs, hpuint nItemsPerLeaf)
+     : m_items(mins.size()) {
+     assert(mins.size() == maxs.size() && nItemsPerLeaf > 0);
+     if(m_items.empty()) return;
+
+     std::iota(std::begin(m_items), std::end(m_items), 0);
+     m_nodes.reserve(2 * (m_items.size() / nItemsPerLeaf) + 1);
+     std::vector<Point3D> centers(m_items.size());
+     for(hpuint i = 0; i < m_items.size(); ++i) centers[i] = hpreal(0.5) * (mins[i] + maxs[i]);
+
+     auto build = [&](hpuint begin, hpuint end, auto& build) -> void {
+          auto n = m_nodes.size();
+          m_nodes.emplace_back();
+          auto min = mins[m_items[begin]], max = maxs[m_items[begin]];
+          auto low = centers[m_items[begin]], high = low;
+          for(auto i = begin + 1; i < end; ++i) {
+               auto item = m_items[i];
+               min = glm::min(min, mins[item]);
+               max = glm::max(max, maxs[item]);
+               low = glm::min(low, centers[item]);
+               high = glm::max(high, centers[item]);
+          }
+          m_nodes[n].min = min;
+          m_nodes[n].max = max;
+          if(end - begin <= nItemsPerLeaf) {
+               m_nodes[n].offset = begin;
+               m_nodes[n].nItems = end - begin;
+               return;
+          }
+
+          auto extent = high - low;
+          auto axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z) ? 1 : 2;
+          auto middle = begin + (end - begin) / 2;
+          std::nth_element(m_items.begin() + begin, m_items.begin() + middle, m_items.begin() + end, [&](hpuint a, hpuint b) { return centers[a][axis] < centers[b][axis]; });
+          build(begin, middle, build);
+          m_nodes[n].offset = m_nodes.size();
+          m_nodes[n].nItems = 0;
+          build(middle, end, build);
+     };
+     build(0, m_items.size(), build);
+}
+
+}//namespace happah
+
@@ -0,0 +1,140 @@
+// Copyright 2017
+//   Pawel Herman - Karlsruhe Institute of Technology - pherman@ira.uka.de
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include "happah/Happah.h"
+#include "happah/geometries/Ray.h"
+#include "happah/math/Space.h"
+
+namespace happah {
+
+/**
+ * Binary hierarchy of axis-aligned bounding boxes over items that are only known by their boxes.  Every node bounds the items below it; the items of a node are split at the median of the centers of their boxes along the axis in which the centers are spread the most, until a node has at most nItemsPerLeaf items.  The nodes are stored depth-first, so the first child of an inner node is the node after it.
+ */
+class BoundingVolumeHierarchy {
+public:
+     struct Node {
+          Point3D min;
+          Point3D max;
+          hpuint offset;//NOTE: Index of the first item of a leaf in the items or index of the second child of an inner node.
+          hpuint nItems;//NOTE: Zero for an inner node.
+
+     };//Node
+
+     BoundingVolumeHierarchy() {}
+
+     /**
+      * @param[in] mins,maxs Corners of the boxes of the items; the ith item is bounded by the box from mins[i] to maxs[i].
+      */
+     BoundingVolumeHierarchy(const std::vector<Point3D>& mins, const std::vector<Point3D>& maxs, hpuint nItemsPerLeaf = 4);
+
+     //NOTE: The items of the leaves, leaf after leaf.
+     const std::vector<hpuint>& getItems() const { return m_items; }
+
+     const std::vector<Node>& getNodes() const { return m_nodes; }
+
+     hpuint getNumberOfItems() const { return m_items.size(); }
+
+     /**
+      * Visit the items whose boxes the ray enters before the ray parameter reaches max, nearer nodes first.  The visitor is called with the index of an item and returns the new maximum, for example, the ray parameter of the nearest intersection found so far, which prunes the nodes that are farther away.
+      */
+     template<class Visitor>
+     void visit(const Ray3D& ray, hpreal max, Visitor&& visit) const {
+          if(m_nodes.empty()) return;
+
+          auto& origin = ray.getOrigin();
+          auto& direction = ray.getDirection();
+          Vector3D inverse(hpreal(1.0) / direction.x, hpreal(1.0) / direction.y, hpreal(1.0) / direction.z);
+          auto enter = [&](const Node& node) -> hpreal {
+               auto t0 = (node.min - origin) * inverse;
+               auto t1 = (node.max - origin) * inverse;
+               auto near = std::max(std::max(std::min(t0.x, t1.x), std::min(t0.y, t1.y)), std::max(std::min(t0.z, t1.z), hpreal(0.0)));
+               auto far = std::min(std::min(std::max(t0.x, t1.x), std::max(t0.y, t1.y)), std::max(t0.z, t1.z));
+               return (near <= far) ? near : std::numeric_limits<hpreal>::infinity();
+          };
+
+          hpuint stack[64];//NOTE: The depth of the hierarchy is logarithmic in the number of items.
+          hpreal entries[64];
+          hpuint n = 0;
+          auto entry = enter(m_nodes[0]);
+          if(entry <= max) {
+               stack[n] = 0;
+               entries[n++] = entry;
+          }
+          while(n > 0) {
+               --n;
+               if(entries[n] > max) continue;
+               auto& node = m_nodes[stack[n]];
+               if(node.nItems > 0) {
+                    for(auto i = m_items.begin() + node.offset, end = i + node.nItems; i != end; ++i) max = visit(*i);
+                    continue;
+               }
+               hpuint first = stack[n] + 1, second = node.offset;
+               auto entry0 = enter(m_nodes[first]), entry1 = enter(m_nodes[second]);
+               if(entry0 > entry1) {
+                    std::swap(first, second);
+                    std::swap(entry0, entry1);
+               }
+               if(entry1 <= max) {
+                    stack[n] = second;
+                    entries[n++] = entry1;
+               }
+               if(entry0 <= max) {
+                    stack[n] = first;
+                    entries[n++] = entry0;
+               }
+          }
+     }
+
+     /**
+      * Visit the items whose boxes are closer to the point than the square root of max2, best first: the nodes are taken from a queue ordered by the distance of their boxes to the point, so the leaves are visited in the order of the distances of their boxes, and the items of a leaf in the order in which they are stored.  The visitor is called with the index of an item and returns the new maximum squared distance, for example, the squared distance to the nearest item found so far; the visit stops as soon as the nearest node left in the queue is farther away.
+      */
+     template<class Visitor>
+     void visit(const Point3D& point, hpreal max2, Visitor&& visit) const {
+          if(m_nodes.empty()) return;
+
+          auto distance2 = [&](const Node& node) -> hpreal {
+               auto offset = glm::max(glm::max(node.min - point, point - node.max), Vector3D(0.0));
+               return glm::dot(offset, offset);
+          };
+
+          //NOTE: Min-heap of the squared distances of the boxes and the indices of the nodes.
+          std::vector<std::pair<hpreal, hpuint> > queue;
+          queue.reserve(64);
+          auto push = [&](hpuint n) {
+               auto distance = distance2(m_nodes[n]);
+               if(distance > max2) return;
+               queue.emplace_back(distance, n);
+               std::push_heap(queue.begin(), queue.end(), std::greater<std::pair<hpreal, hpuint> >());
+          };
+
+          push(0);
+          while(!queue.empty() && queue.front().first <= max2) {
+               auto n = queue.front().second;
+               std::pop_heap(queue.begin(), queue.end(), std::greater<std::pair<hpreal, hpuint> >());
+               queue.pop_back();
+               auto& node = m_nodes[n];
+               if(node.nItems > 0) for(auto i = m_items.begin() + node.offset, end = i + node.nItems; i != end; ++i) max2 = visit(*i);
+               else {
+                    push(n + 1);
+                    push(node.offset);
+               }
+          }
+     }
+
+private:
+     std::vector<hpuint> m_items;
+     std::vector<Node> m_nodes;
+
+};//BoundingVolumeHierarchy
+
+}//namespace happah
+
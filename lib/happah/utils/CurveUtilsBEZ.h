@@ -9,6 +9,22 @@
 #include "happah/math/MathUtils.h"
 
 class CurveUtilsBEZ {
+public:
+     /**
+      * Evaluate all Bernstein polynomials of degree t_degree at t in one sweep; see SurfaceUtilsBEZ::evaluateBasis.
+      * @param[basis] Room for t_degree + 1 values; the ith one is B^n_i.
+      */
+     template<hpuint t_degree>
+     static void evaluateBasis(hpreal t, hpreal* basis) {
+          hpreal ts[t_degree + 1], oneMinusTs[t_degree + 1];
+          ts[0] = oneMinusTs[0] = 1.0;
+          for(hpuint i = 1; i <= t_degree; ++i) {
+               ts[i] = ts[i - 1] * t;
+               oneMinusTs[i] = oneMinusTs[i - 1] * (1.0 - t);
+          }
+          for(hpuint i = 0; i <= t_degree; ++i) basis[i] = hpreal(MathUtils::binom<false>(t_degree, i)) * ts[i] * oneMinusTs[t_degree - i];
+     }
+
      /**
       * Evaluate the Bernstein polynomial B^n_i.
       */
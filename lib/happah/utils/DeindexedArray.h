@@ -11,15 +11,16 @@
 
 namespace happah {
 
-template<class Data>
+//NOTE: The indices may have any width; they are read through iterators of type IndexIterator.
+template<class Data, class IndexIterator = Indices::const_iterator>
 class DeindexedArray {
-     class Iterator : std::iterator<std::bidirectional_iterator_tag, typename Data::const_iterator::value_type, typename Indices::const_iterator::difference_type> {
+     class Iterator : std::iterator<std::bidirectional_iterator_tag, typename Data::const_iterator::value_type, typename std::iterator_traits<IndexIterator>::difference_type> {
      public:
-          using difference_type = typename Indices::const_iterator::difference_type;
+          using difference_type = typename std::iterator_traits<IndexIterator>::difference_type;
           using value_type = typename Data::const_iterator::value_type;
 
           Iterator(const DeindexedArray& array, hpuint offset) 
-               : m_data(array.m_data), m_i(array.m_indices.cbegin() + offset) {}
+               : m_data(array.m_data), m_i(array.m_begin + offset) {}
 
           difference_type operator-(const Iterator& iterator) const { return m_i - iterator.m_i; }
 
@@ -65,15 +66,15 @@ class DeindexedArray {
 
      private:
           const Data& m_data;
-          typename Indices::const_iterator m_i;
+          IndexIterator m_i;
 
      };//Iterator
 
 public:
      using const_iterator = Iterator;
 
-     DeindexedArray(const Data& data, const Indices& indices)
-          : m_data(data), m_indices(indices) {}
+     DeindexedArray(const Data& data, IndexIterator begin, IndexIterator end)
+          : m_begin(begin), m_data(data), m_end(end) {}
 
      const_iterator begin() const { return Iterator(*this, 0); }
 
@@ -81,16 +82,20 @@ public:
 
      const_iterator cend() const { return end(); }
 
-     const_iterator end() const { return Iterator(*this, m_indices.size()); }
+     const_iterator end() const { return Iterator(*this, m_end - m_begin); }
 
 private:
+     IndexIterator m_begin;
      const Data& m_data;
-     const Indices& m_indices;
+     IndexIterator m_end;
 
 };//DeindexedArray
 
-template<class Data>
-DeindexedArray<Data> deindex(const Data& data, const Indices& indices) { return { data, indices }; }
+template<class Data, class Indices>
+DeindexedArray<Data, typename Indices::const_iterator> deindex(const Data& data, const Indices& indices) { return { data, indices.cbegin(), indices.cend() }; }
+
+template<class Data, class IndexIterator>
+DeindexedArray<Data, IndexIterator> deindex(const Data& data, IndexIterator begin, IndexIterator end) { return { data, begin, end }; }
 
 }//namespace happah
 
@@ -11,6 +11,7 @@
 #include "happah/geometries/TriangleMesh.h"
 
 #include <boost/functional/hash.hpp>
+#include <cilk/cilk.h>
 #include <unordered_map>
 #include <tuple>
 
@@ -83,13 +84,13 @@ public:
 
           std::vector<hpuint> es(nEdges, -1);//TODO: in case there are future stringent memory requirements, this vector can be avoided
 
-          auto v = 0u;
-          for(auto& vertex : vertices0) {
-               std::vector<hpuint> temp;
-               visit_ring(mesh.getEdges(), mesh.getOutgoing(v++), [&](hpuint w) { temp.push_back(w); });
-               auto ring = deindex(vertices0, temp);
-               vertices1.emplace_back(m_vertexRule(vertex, begin(ring), end(ring)));
-          }
+          Indices offsets, rings;
+          std::tie(offsets, rings) = make_rings(mesh);
+          vertices1.resize(nVertices);
+          cilk_for(hpuint v = 0; v < nVertices; ++v) visit_ring(offsets, rings, v, [&](Indices::const_iterator begin, Indices::const_iterator end) {
+               auto ring = deindex(vertices0, begin, end);
+               vertices1[v] = m_vertexRule(vertices0[v], ring.begin(), ring.end());
+          });
 
           for(auto e = 0u; e < nEdges; ++e) {
                if(es[e] != -1) continue;
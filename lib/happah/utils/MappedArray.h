@@ -0,0 +1,88 @@
+// Copyright 2016
+//   Pawel Herman - Karlsruhe Institute of Technology - pherman@ira.uka.de
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <memory>
+#include <vector>
+
+#include "happah/Happah.h"
+
+namespace happah {
+
+/*
+ * @section DESCRIPTION
+ *
+ * A mapped array is a read-only view of an array of trivially copyable elements
+ * stored in a memory-mapped file.  Copies of a mapped array share the mapping,
+ * which is released when the last copy is destroyed.  Its interface is the
+ * read-only part of the interface of std::vector.
+ */
+template<class T>
+class MappedArray {
+     static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable elements can be read from a memory-mapped file.");
+
+public:
+     using const_iterator = const T*;
+     using File = boost::iostreams::mapped_file_source;
+     using iterator = const T*;
+     using value_type = T;
+
+     MappedArray()
+          : m_begin(nullptr), m_size(0) {}
+
+     //NOTE: The offset is given in bytes from the beginning of the file and has to be aligned for T.
+     MappedArray(std::shared_ptr<File> file, std::size_t offset, std::size_t size)
+          : m_begin(reinterpret_cast<const T*>(file->data() + offset)), m_file(std::move(file)), m_size(size) {}
+
+     const T& back() const { return m_begin[m_size - 1]; }
+
+     const_iterator begin() const { return m_begin; }
+
+     const_iterator cbegin() const { return m_begin; }
+
+     const_iterator cend() const { return m_begin + m_size; }
+
+     const T* data() const { return m_begin; }
+
+     bool empty() const { return m_size == 0; }
+
+     const_iterator end() const { return m_begin + m_size; }
+
+     const T& front() const { return *m_begin; }
+
+     std::size_t size() const { return m_size; }
+
+     const T& operator[](std::size_t i) const { return m_begin[i]; }
+
+private:
+     const T* m_begin;
+     std::shared_ptr<File> m_file;
+     std::size_t m_size;
+
+};//MappedArray
+
+/*
+ * @section DESCRIPTION
+ *
+ * A storage policy decides which container holds the vertices and indices of
+ * models and meshes.  Heap storage uses std::vector; mapped storage uses read-only
+ * views of memory-mapped files, see make_mapped_triangle_mesh.
+ */
+struct HeapStorage {
+     template<class T>
+     using Array = std::vector<T>;
+
+};//HeapStorage
+
+struct MappedStorage {
+     template<class T>
+     using Array = MappedArray<T>;
+
+};//MappedStorage
+
+}//namespace happah
+
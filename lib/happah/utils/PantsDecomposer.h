@@ -361,7 +361,7 @@ private:
                SourcesIterator temp = sourcesBegin+1;
                hpuint next = (temp == sourcesEnd) ? -1 : *temp;
                bool none = true;
-               visit_spokes(m_mesh, current, [&](const Edge& edge) {
+               visit_spokes(m_mesh, m_mesh.getOutgoing(current), [&](const Edge& edge) {
                     auto target = edge.vertex;
                     if(target != previous && target != next && std::binary_search(targets.begin(), targets.end(), target)) {
                          m_mesh.splitEdge(edge.opposite);
@@ -5,20 +5,84 @@
 
 #pragma once
 
+#include <array>
+#include <mutex>
+#include <tuple>
+#include <utility>
+#include <vector>
+
 #include "happah/utils/SurfaceUtilsBEZ.h"
 
 namespace happah {
 
-//TODO: micro-optimizations
-//NOTE: Here we subdivide a single surface piece.
+//NOTE: Here we subdivide a single surface piece.  A bisection splits the parameter triangle at the midpoint m of the edge opposite its first corner c0 into the triangles (m, c0, c1) and (m, c2, c0), whose first corners are again opposite the edges split next.  One subdivision bisects the triangle and then both halves, which yields four triangles similar to the triangle, so n subdivisions split it into 4^n triangles whose corners lie on the grid with 2^n rows.  Every control point of a subdivided patch has a domain point on the grid of domain points of a patch of degree 2^n times the degree; the control points of the subdivided patches are stored at their domain points in the order of the control points of that patch, and neighboring subdivided patches share the control points on their common edge.
 template<class Space, hpuint t_degree>
 class SurfaceSubdividerBEZ {
      static_assert(t_degree > 1, "Surface subdivision only makes sense for degree greater than one because a surface of degree one is planar.");
      using Point = typename Space::POINT;
      using ControlPoints = std::vector<Point>;
 
+     static constexpr hpuint N_CONTROL_POINTS = SurfaceUtilsBEZ::get_number_of_control_points<t_degree>::value;
+     static constexpr hpuint N_SUBDIVIDED_POINTS = SurfaceUtilsBEZ::get_number_of_control_points<(t_degree << 1)>::value;
+
 public:
+     /**
+      * Schedule, computed at compile time, of the de Casteljau steps that subdivide a patch once.  The points are numbered in the order in which they are computed: the control points of the patch come first and every step appends the midpoint of two earlier points.  A bisection is a pyramid of (degree + 2) * (degree + 1) * degree / 6 steps at the midpoint of the edge opposite the first corner; its sides are the control points of the two halves.  The subdivision bisects the patch and then both halves, so it takes three pyramids.  Neighboring patches share the points on their common edge, so only the first of the control points of the four patches that are the same point is stored.
+      */
+     struct Schedule {
+          static constexpr hpuint N_PYRAMID_POINTS = (t_degree + 2) * (t_degree + 1) * t_degree / 6;
+          static constexpr hpuint N_AVERAGES = 3 * N_PYRAMID_POINTS;
+          static constexpr hpuint N_POINTS = N_CONTROL_POINTS + N_AVERAGES;
+
+          hpuint averages[N_AVERAGES][2];
+          hpuint stores[N_SUBDIVIDED_POINTS][2];//NOTE: The index of a control point of the four patches in the order of getIndices and the point.
+
+          constexpr Schedule()
+               : averages{}, stores{}, m_nAverages(0) {
+               hpuint patch[N_CONTROL_POINTS] = {}, halves[2 * N_CONTROL_POINTS] = {}, results[4 * N_CONTROL_POINTS] = {};
+               for(hpuint i = 0; i < N_CONTROL_POINTS; ++i) patch[i] = i;
+               bisect(patch, halves);
+               bisect(halves, results);
+               bisect(halves + N_CONTROL_POINTS, results + 2 * N_CONTROL_POINTS);
+
+               bool stored[N_POINTS] = {};
+               hpuint nStores = 0;
+               for(hpuint i = 0; i < 4 * N_CONTROL_POINTS; ++i) if(!stored[results[i]]) {
+                    stored[results[i]] = true;
+                    stores[nStores][0] = i;
+                    stores[nStores][1] = results[i];
+                    ++nStores;
+               }
+          }
 
+     private:
+          hpuint m_nAverages;
+
+          //NOTE: Index of the control point with indices (i, j, k) of a patch of the given degree.
+          static constexpr hpuint index(hpuint degree, hpuint j, hpuint k) { return k * (degree + 1) - ((k * (k - 1)) >> 1) + j; }
+
+          //NOTE: The rth level of the pyramid holds the blossom at (m^r, c0^i, c1^j, c2^k), stored like the control points of a patch of the degree minus r; the control points of the half (m, c0, c1) are followed by those of the half (m, c2, c0).
+          constexpr void bisect(const hpuint* patch, hpuint* halves) {
+               hpuint pyramid[t_degree + 1][N_CONTROL_POINTS] = {};
+               for(hpuint i = 0; i < N_CONTROL_POINTS; ++i) pyramid[0][i] = patch[i];
+               for(hpuint r = 1; r <= t_degree; ++r) for(hpuint k = 0; k <= t_degree - r; ++k) for(hpuint j = 0; j + k <= t_degree - r; ++j) {
+                    averages[m_nAverages][0] = pyramid[r - 1][index(t_degree - r + 1, j + 1, k)];
+                    averages[m_nAverages][1] = pyramid[r - 1][index(t_degree - r + 1, j, k + 1)];
+                    pyramid[r][index(t_degree - r, j, k)] = N_CONTROL_POINTS + m_nAverages;
+                    ++m_nAverages;
+               }
+               for(hpuint k = 0; k <= t_degree; ++k) for(hpuint j = 0; j + k <= t_degree; ++j) {
+                    auto i = t_degree - j - k;
+                    halves[index(t_degree, j, k)] = pyramid[i][index(j + k, k, 0)];
+                    halves[N_CONTROL_POINTS + index(t_degree, j, k)] = pyramid[i][index(j + k, 0, j)];
+               }
+          }
+
+     };//Schedule
+
+     /**
+      * @return Points of the grid of the parameter triangles of the subdivided patches in the triangle with the corners p0, p1, and p2, and three indices per subdivided patch into the points, in the order in which getIndices lists the patches.
+      */
      template<class Point>
      static std::pair<std::vector<Point>, std::vector<hpuint> > getParameterPoints(const Point& p0, const Point& p1, const Point& p2, hpuint nSubdivisions) {
           assert(nSubdivisions > 0);
@@ -26,196 +90,21 @@ public:
           std::vector<Point> points;
           std::vector<hpuint> indices;
 
-          const hpuint degree = 1 << nSubdivisions;
+          const hpuint nRows = 1 << nSubdivisions;
 
-          points.reserve(SurfaceUtilsBEZ::getNumberOfControlPoints(degree));
+          points.reserve(SurfaceUtilsBEZ::getNumberOfControlPoints(nRows));
 
-          SurfaceUtilsBEZ::sample(degree + 1, [&] (hpreal u, hpreal v, hpreal w) {
+          SurfaceUtilsBEZ::sample(nRows + 1, [&] (hpreal u, hpreal v, hpreal w) {
                points.push_back(u * p0 + v * p1 + w * p2);
           });
 
-          //NOTE: Make sure when arranging the vertices that their order respects the orientation of the patch in the spline.  In other words, there is only one correct counterclockwise arrangement possible for each patch's parameter triangle.
-          //NOTE: The diagram in the notes has p0 in the upper corner and not p2 as usual.  This rotation of the parameter vertices is a side effect of the subdivision algorithm because we have to start the recursion in the case EEB.
-          switch(degree) {
-          case 2: 
-               indices = {
-                    0, 1, 3,
-                    1, 2, 3,
-                    2, 4, 3,
-                    4, 5, 3
-               };
-               break;
-          case 4:
-               indices = {
-                    0, 1, 5,
-                    1, 2, 5,
-                    2, 6, 5,
-                    6, 9, 5,
-                    2, 3, 7,
-                    6, 2, 7,
-                    9, 6, 7,
-                    10, 9, 7,
-                    9, 10, 12,
-                    3, 4, 7,
-                    4, 8, 7,
-                    8, 11, 7,
-                    11, 10, 7,
-                    10, 11, 12,
-                    11, 13, 12,
-                    13, 14, 12
-               };
-               break;
-          case 8:
-               indices = {
-                    0, 1, 9,
-                    1, 2, 9,
-                    2, 10, 9,
-                    10, 17, 9,
-                    2, 3, 11,
-                    10, 2, 11,
-                    17, 10, 11,
-                    18, 17, 11,
-                    17, 18, 24,
-                    3, 4, 11,
-                    4, 12, 11,
-                    12, 19, 11,
-                    19, 18, 11,
-                    18, 19, 24,
-                    19, 25, 24,
-                    25, 30, 24,
-                    4, 5, 13,
-                    12, 4, 13,
-                    19, 12, 13,
-                    20, 19, 13,
-                    19, 20, 26,
-                    25, 19, 26,
-                    30, 25, 26,
-                    31, 30, 26,
-                    30, 31, 35,
-                    5, 6, 13,
-                    6, 14, 13,
-                    14, 21, 13,
-                    21, 20, 13,
-                    20, 21, 26,
-                    21, 27, 26,
-                    27, 32, 26,
-                    32, 31, 26,
-                    31, 32, 35,
-                    32, 36, 35,
-                    36, 39, 35,
-                    6, 7, 15,
-                    14, 6, 15,
-                    21, 14, 15,
-                    22, 21, 15,
-                    21, 22, 28,
-                    27, 21, 28,
-                    32, 27, 28,
-                    33, 32, 28,
-                    32, 33, 37,
-                    36, 32, 37,
-                    39, 36, 37,
-                    40, 39, 37,
-                    39, 40, 42,
-                    7, 8, 15,
-                    8, 16, 15,
-                    16, 23, 15,
-                    23, 22, 15,
-                    22, 23, 28,
-                    23, 29, 28,
-                    29, 34, 28,
-                    34, 33, 28,
-                    33, 34, 37,
-                    34, 38, 37,
-                    38, 41, 37,
-                    41, 40, 37,
-                    40, 41, 42,
-                    41, 43, 42,
-                    43, 44, 42
-               };
-               break;
-          default: {
-                    indices.reserve(3 * SurfaceUtilsBEZ::getNumberOfControlPolygonTriangles(degree));
-
-                    hpuint temp[] = { 0, 1, degree + 1, 1, 2, degree + 1, 2, degree + 2, degree + 1, degree + 2, (degree << 1) + 1, degree + 1 };
-                    indices.insert(indices.end(), temp, temp + 12);
-
-                    hpuint r = 2;//row
-                    while(r < degree) {
-                         hpuint c, vt, vb, o;
-
-                         //even row
-                         c = 0;
-                         vt = r;
-                         vb = vt + 1;
-                         o = degree;
-                         while(c < r) {
-                              hpuint vnt = vt + o;
-                              hpuint vnb = vb + o;
-                              --o;
-
-                              hpuint vs1[] = { vt, vb, vnb, vnt, vt, vnb };
-                              indices.insert(indices.end(), vs1, vs1 + 6);
-
-                              vt = vnt;
-                              vb = vnb;
-
-                              vnt += o;
-                              vnb += o;
-                              --o;
-
-                              hpuint vs2[] = { vnt, vt, vb, vnb, vnt, vb };
-                              indices.insert(indices.end(), vs2, vs2 + 6);
-
-                              vt = vnt;
-                              vb = vnb;
-
-                              c += 2;
-                         }
-
-                         indices.push_back(vt);
-                         indices.push_back(vb);
-                         indices.push_back(vb + o);
-
-                         //odd row
-                         c = 0;
-                         vt = r + 1;
-                         vb = vt + 1;
-                         o = degree;
-                         while(c < r) {
-                              hpuint vnt = vt + o;
-                              hpuint vnb = vb + o;
-                              --o;
-
-                              hpuint vs1[] = { vt, vb, vnt, vb, vnb, vnt };
-                              indices.insert(indices.end(), vs1, vs1 + 6);
-
-                              vt = vnt;
-                              vb = vnb;
-
-                              vnt += o;
-                              vnb += o;
-                              --o;
-
-                              hpuint vs2[] = { vb, vnb, vt, vnb, vnt, vt };
-                              indices.insert(indices.end(), vs2, vs2 + 6);
-
-                              vt = vnt;
-                              vb = vnb;
-
-                              c += 2;
-                         }
-
-                         hpuint vnt = vt + o;
-                         hpuint vnb = vb + o;
-                         --o;
-
-                         hpuint vs[] = { vt, vb, vnt, vb, vnb, vnt, vnb, vnb + o, vnt };
-                         indices.insert(indices.end(), vs, vs + 9);
-
-                         r += 2;
-                    }
-               }
-          };
+          //NOTE: The triangles are the parameter triangles of the subdivided patches in the order of getIndices.
+          indices.reserve(3 * SurfaceUtilsBEZ::getNumberOfControlPolygonTriangles(nRows));
+          visit_triangles(nSubdivisions, [&](hpuint x0, hpuint y0, hpuint x1, hpuint y1, hpuint x2, hpuint y2) {
+               indices.push_back(getOffset(nRows, y0) + x0);
+               indices.push_back(getOffset(nRows, y1) + x1);
+               indices.push_back(getOffset(nRows, y2) + x2);
+          });
 
           return std::make_pair(std::move(points), std::move(indices));
      }
@@ -223,1213 +112,152 @@ public:
      //NOTE: The control points are ordered left to right starting at the bottom row and ending at the top row, which contains one point.
      template<class Iterator>
      SurfaceSubdividerBEZ(Iterator controlPoints) {
-          //TODO: specialize for degree 2, 3
-          //organize the input control points into the arrays as specified by the algorithm
-          m_oFacePoints.resize(FACE_STRIDE);
-          m_oEdgePoints.resize(3 * EDGE_STRIDE);
-          m_oVertexPoints.resize(3);
-
-          auto v = m_oVertexPoints.begin();
-          auto i = controlPoints;
-          auto f = m_oFacePoints.begin();
-          auto e0 = m_oEdgePoints.begin();
-          auto e1 = e0 + EDGE_STRIDE;
-          auto e2 = e1 + EDGE_STRIDE;
-
-          *v = *i;
-          ++i;
-          for(auto end = i + EDGE_STRIDE; i != end; ++i, ++e0) *e0 = *i;
-          *(++v) = *i;
-
-          auto nMiddlePoints = t_degree - 1;
-          while(nMiddlePoints > 0) {
-               --nMiddlePoints;
-               *e1 = *(++i);
-               ++e1;
-               auto end = f;
-               f += nMiddlePoints;
-               auto f0 = f;
-               while(f0 != end) *(--f0) = *(++i);
-               *e2 = *(++i);
-               ++e2;
+          for(auto& point : m_controlPoints) {
+               point = *controlPoints;
+               ++controlPoints;
           }
-
-          *(++v) = *(++i);
      }
 
-     std::tuple<ControlPoints, Indices> subdivide(hpuint nSubdivisions) {
-          assert(nSubdivisions > 0);
-          //TODO: specialize for degree 2, 3
-
-          //calculate number of points of each type
-          auto nRows = 1 << nSubdivisions;//NOTE: A row consists of zero or more rectangles followed by a triangle.
-          auto nRectangles = (nRows * (nRows - 1)) >> 1;//NOTE: The number of rectangles is the result of the arithmetic series for (nRows-1).  The first row has no rectangles and each following row has one rectangle more than the previous row.
-          auto nTriangles = (nRectangles << 1) + nRows;
-          auto nEdges = 3 * (nRectangles + nRows);//NOTE: We count the three bottom left edges in each triangle so as not to count the top edge and the right edge are not counted twice.  Then, three edges per triangle at the end of each row remain to be counted.
-          auto nFacePoints = nTriangles * FACE_STRIDE;//NOTE: This is the number of points not on the border.
-          auto nEdgePoints = nEdges * EDGE_STRIDE;
-          auto nVertexPoints = nRectangles + (nRows << 1) + 1;
-
-          auto facePointsA = ControlPoints(nFacePoints);
-          auto facePointsB = ControlPoints(nFacePoints);
-          auto facePointsC = ControlPoints(FACE_STRIDE << 1);//stores two temporary faces generated by first binary subdivision
-          auto edgePointsA = ControlPoints(nEdgePoints);
-          auto edgePointsB = ControlPoints(nEdgePoints);
-          auto vertexPointsA = ControlPoints(nVertexPoints);
-          auto vertexPointsB = ControlPoints(nVertexPoints);
-
-          auto uf0 = facePointsC.begin();
-          auto uf1 = uf0 + FACE_STRIDE;
-
-          {
-               auto svt = m_oVertexPoints.begin();//top source vertices
-               auto svb = svt + 1;//bottom source vertices
-               auto sev = m_oEdgePoints.begin();//non-horizontal source edges
-               auto seh = sev + (EDGE_STRIDE << 1);//horizontal source edges
-               auto sf = m_oFacePoints.begin();//source face
-
-               auto tvt = vertexPointsA.begin();//top target vertices
-               auto tvm = tvt + 1;//middle target vertices
-               auto tvb = tvm + 2;//bottom target vertices
-               auto tevt = edgePointsA.begin();//non-horizontal top target edges
-               auto tevb = tevt + (EDGE_STRIDE << 1);//non-horizontal bottom target edges
-               auto teht = tevt + (6 * EDGE_STRIDE);//horizontal top target edges
-               auto tehb = teht + EDGE_STRIDE;//horizontal bottom target edges
-               auto tft = facePointsA.begin();//top target faces
-               auto tfb = tft + FACE_STRIDE;//bottom target faces
-
-               subdivideEEB(svt, svb, sev, seh, sf, tvt, tvm, tvb, tevt, tevb, teht, tehb, tft, tfb, uf0, uf1);
-
-               auto iv = m_oVertexPoints.begin();
-               auto ov = vertexPointsA.begin();
-               *ov = *iv;
-               ++iv;
-               *(ov + 3) = *iv;
-               ++iv;
-               *(ov + 5) = *iv;
-          }
-
-          auto sFacePoints = &facePointsA;//source points
-          auto sEdgePoints = &edgePointsA;
-          auto sVertexPoints = &vertexPointsA;
-          auto tFacePoints = &facePointsB;//target points
-          auto tEdgePoints = &edgePointsB;
-          auto tVertexPoints = &vertexPointsB;
-          for(auto i = 1u; i < nSubdivisions; ++i) {
-               auto snRows = 1u << i;
-               auto snNonHorizontalEdges = snRows * (snRows + 1);
-               auto tnRows = 1u << (i + 1);
-               auto tnNonHorizontalEdges = tnRows * (tnRows + 1);
-
-               auto svt = sVertexPoints->begin();//same meaning as above
-               auto svb = svt + 1;
-               auto sev = sEdgePoints->begin();
-               auto sehb = sev + (snNonHorizontalEdges * EDGE_STRIDE);
-               auto seht = sehb;
-               auto sf = sFacePoints->begin();
-
-               auto tvt = tVertexPoints->begin();//same meaning as above
-               auto tvm = tvt + 1;
-               auto tvb = tvm + 2;
-               auto tevt = tEdgePoints->begin();
-               auto tevb = tevt + (EDGE_STRIDE << 1);
-               auto tehm = tEdgePoints->begin() + (tnNonHorizontalEdges * EDGE_STRIDE);
-               auto tehb = tehm + EDGE_STRIDE;
-               auto teht = tehb;
-               auto tft = tFacePoints->begin();
-               auto tfb = tft + FACE_STRIDE;
-
-               auto r = 0u;
-               while(true) {
-                    hpuint c;
-
-                    c = 0;
-                    while(c < r) {//subdivide triangles in even row
-                         subdivideEEB<true>(svt, svb, sev, sehb, sf, tvt, tvm, tvb, tevt, tevb, tehm, tehb, tft, tfb, uf0, uf1, c > 0);
-                         *tvt = *svt;
-
-                         ++svb;
-                         sev += EDGE_STRIDE;
-                         sehb += EDGE_STRIDE;
-                         sf += FACE_STRIDE;
-
-                         ++tvm;
-                         tvb += 2;
-                         tevt += EDGE_STRIDE;
-                         tevb += (3 * EDGE_STRIDE);
-                         tehm += EDGE_STRIDE;
-                         tehb += (EDGE_STRIDE << 1);
-                         tft += FACE_STRIDE;
-                         tfb += (3 * FACE_STRIDE);
-
-                         subdivideEET(svt, svb, sev, seht, sf, tvt, tvm, tvb, tevt, tevb, teht, tehm, tft, tfb, uf0, uf1);
-
-                         ++svt;
-                         sev += EDGE_STRIDE;
-                         seht += EDGE_STRIDE;
-                         sf += FACE_STRIDE;
-
-                         tvt += 2;
-                         ++tvm;
-                         tevt += (3 * EDGE_STRIDE);
-                         tevb += EDGE_STRIDE;
-                         teht += (EDGE_STRIDE << 1);
-                         tehm += EDGE_STRIDE;
-                         tft += (3 * FACE_STRIDE);
-                         tfb += FACE_STRIDE;
-
-                         ++c;
-
-                         subdivideEOT(svt, svb, sev, seht, sf, tvt, tvm, tvb, tevt, tevb, teht, tehm, tft, tfb, uf0, uf1);
-                         *tvt = *svt;
-
-                         ++svt;
-                         sev += EDGE_STRIDE;
-                         seht += EDGE_STRIDE;
-                         sf += FACE_STRIDE;
-
-                         tvt += 2;
-                         ++tvm;
-                         tevt += (3 * EDGE_STRIDE);
-                         tevb += EDGE_STRIDE;
-                         teht += (EDGE_STRIDE << 1);
-                         tehm += EDGE_STRIDE;
-                         tft += (3 * FACE_STRIDE);
-                         tfb += FACE_STRIDE;
-
-                         subdivideEOB(svt, svb, sev, sehb, sf, tvt, tvm, tvb, tevt, tevb, tehm, tehb, tft, tfb, uf0, uf1);
-
-                         ++svb;
-                         sev += EDGE_STRIDE;
-                         sehb += EDGE_STRIDE;
-                         sf += FACE_STRIDE;
-
-                         ++tvm;
-                         tvb += 2;
-                         tevt += EDGE_STRIDE;
-                         tevb += (3 * EDGE_STRIDE);
-                         tehm += EDGE_STRIDE;
-                         tehb += (EDGE_STRIDE << 1);
-                         tft += FACE_STRIDE;
-                         tfb += (3 * FACE_STRIDE);
-
-                         ++c;
-                    }
-
-                    //subdivide last triangle in row
-                    subdivideEEB<true>(svt, svb, sev, sehb, sf, tvt, tvm, tvb, tevt, tevb, tehm, tehb, tft, tfb, uf0, uf1, c > 0);
-                    *tvt = *svt;
-
-                    ++svt;
-                    svb += 2;
-                    sev += (EDGE_STRIDE << 1);
-                    sehb += EDGE_STRIDE;
-                    sf += FACE_STRIDE;
-
-                    tvt = tvm + 2;
-                    tvm = tvb + 3;
-                    tevt = tevb + (EDGE_STRIDE << 2);
-                    tevb = tevt + (((r << 2) + 6) * EDGE_STRIDE);
-                    teht = tehm + EDGE_STRIDE;
-                    tehm = tehb + (EDGE_STRIDE << 1);
-                    ++r;
-                    tvb = tvm + ((r << 1) + 2);
-                    tehb = tehm + (((r << 1) + 1) * EDGE_STRIDE);
-                    tft = tfb + (3 * FACE_STRIDE);
-                    tfb = tft + (((r << 2) + 1) * FACE_STRIDE);
-
-                    c = 0;
-                    bool notLastRow = (r+1) != snRows;
-                    while(c < r) {//subdivide triangles in odd row; subdivide bottom horizontal edge if this is the last row
-                         subdivideOET(svt, svb, sev, seht, sf, tvt, tvm, tvb, tevt, tevb, teht, tehm, tft, tfb, uf0, uf1, c > 0);
-                         *tvt = *svt;
-
-                         ++svt;
-                         sev += EDGE_STRIDE;
-                         seht += EDGE_STRIDE;
-                         sf += FACE_STRIDE;
-
-                         tvt += 2;
-                         ++tvm;
-                         tevt += (3 * EDGE_STRIDE);
-                         tevb += EDGE_STRIDE;
-                         teht += (EDGE_STRIDE << 1);
-                         tehm += EDGE_STRIDE;
-                         tft += (3 * FACE_STRIDE);
-                         tfb += FACE_STRIDE;
-
-                         subdivideOEB(svt, svb, sev, sehb, sf, tvt, tvm, tvb, tevt, tevb, tehm, tehb, tft, tfb, uf0, uf1, notLastRow);
-
-                         ++svb;
-                         sev += EDGE_STRIDE;
-                         sehb += EDGE_STRIDE;
-                         sf += FACE_STRIDE;
-
-                         ++tvm;
-                         tvb += 2;
-                         tevt += EDGE_STRIDE;
-                         tevb += (3 * EDGE_STRIDE);
-                         tehm += EDGE_STRIDE;
-                         tehb += (EDGE_STRIDE << 1);
-                         tft += FACE_STRIDE;
-                         tfb += (3 * FACE_STRIDE);
-
-                         ++c;
-                         if(c == r) break;
-
-                         subdivideOOB(svt, svb, sev, sehb, sf, tvt, tvm, tvb, tevt, tevb, tehm, tehb, tft, tfb, uf0, uf1, notLastRow);
-
-                         ++svb;
-                         sev += EDGE_STRIDE;
-                         sehb += EDGE_STRIDE;
-                         sf += FACE_STRIDE;
-
-                         ++tvm;
-                         tvb += 2;
-                         tevt += EDGE_STRIDE;
-                         tevb += (3 * EDGE_STRIDE);
-                         tehm += EDGE_STRIDE;
-                         tehb += (EDGE_STRIDE << 1);
-                         tft += FACE_STRIDE;
-                         tfb += (3 * FACE_STRIDE);
-
-                         subdivideOOT(svt, svb, sev, seht, sf, tvt, tvm, tvb, tevt, tevb, teht, tehm, tft, tfb, uf0, uf1);
-                         *tvt = *svt;
-
-                         ++svt;
-                         sev += EDGE_STRIDE;
-                         seht += EDGE_STRIDE;
-                         sf += FACE_STRIDE;
-
-                         tvt += 2;
-                         ++tvm;
-                         tevt += (3 * EDGE_STRIDE);
-                         tevb += EDGE_STRIDE;
-                         teht += (EDGE_STRIDE << 1);
-                         tehm += EDGE_STRIDE;
-                         tft += (3 * FACE_STRIDE);
-                         tfb += FACE_STRIDE;
-
-                         ++c;
-                    }
-
-                    //subdivide last triangle in row
-                    subdivideOOB(svt, svb, sev, sehb, sf, tvt, tvm, tvb, tevt, tevb, tehm, tehb, tft, tfb, uf0, uf1, notLastRow);
-                    *tvt = *svt;
-
-                    ++svt;
-                    svb += 2;
-                    sev += (EDGE_STRIDE << 1);
-                    sehb += EDGE_STRIDE;
-                    sf += FACE_STRIDE;
-
-                    tvt = tvm + 2;
-                    tvm = tvb + 3;
-                    tevt = tevb + (EDGE_STRIDE << 2);
-                    tevb = tevt + (((r << 2) + 6) * EDGE_STRIDE);
-                    teht = tehm + EDGE_STRIDE;
-                    tehm = tehb + (EDGE_STRIDE << 1);
-                    ++r;
-                    if(r == snRows) break;
-                    tvb = tvm + ((r << 1) + 2);
-                    tehb = tehm + (((r << 1) + 1) * EDGE_STRIDE);
-                    tft = tfb + (3 * FACE_STRIDE);
-                    tfb = tft + (((r << 2) + 1) * FACE_STRIDE);
-               }
-
-               //add common control points at triangle vertices in bottom row to target
-               for(hpuint j = 0, end = snRows + 1; j < end; ++j) {
-                    *tvt = *svt;
-                    ++svt;
-                    tvt += 2;
-               }
-               
-               if((i & 1) == 0) {
-                    sFacePoints = &facePointsA;//source points
-                    sEdgePoints = &edgePointsA;
-                    sVertexPoints = &vertexPointsA;
-                    tFacePoints = &facePointsB;//target points
-                    tEdgePoints = &edgePointsB;
-                    tVertexPoints = &vertexPointsB;
-               } else {
-                    sFacePoints = &facePointsB;//source points
-                    sEdgePoints = &edgePointsB;
-                    sVertexPoints = &vertexPointsB;
-                    tFacePoints = &facePointsA;//target points
-                    tEdgePoints = &edgePointsA;
-                    tVertexPoints = &vertexPointsA;
-               } 
-          }
-
-          ControlPoints points;
-
-          if((nSubdivisions & 1) == 0) {
-               points = std::move(facePointsB);
-               points.reserve(nFacePoints + nEdgePoints + nVertexPoints);
-               points.insert(points.end(), edgePointsB.begin(), edgePointsB.end());
-               points.insert(points.end(), vertexPointsB.begin(), vertexPointsB.end());
-          } else {
-               points = std::move(facePointsA);
-               points.reserve(nFacePoints + nEdgePoints + nVertexPoints);
-               points.insert(points.end(), edgePointsA.begin(), edgePointsA.end());
-               points.insert(points.end(), vertexPointsA.begin(), vertexPointsA.end());
-          }
-
-          Indices indices;
-          indices.reserve(nTriangles * SurfaceUtilsBEZ::getNumberOfControlPoints(t_degree));
-
-          auto vt = nFacePoints + nEdgePoints;
-          auto vb = vt + 1;
-          auto ev = nFacePoints;
-          auto ehb = ev + nRows * (nRows + 1) * EDGE_STRIDE;//top horizontal edge
-          auto eht = ehb;//bottom horizontal edge
-          auto f = 0u;
-          hpuint limit, nMiddlePoints;
-          hpuint tev;//holds index of ev temporarily
-          auto r = 0u;
-          while(r < nRows) {
-               hpuint c;
-
-               c = 0;
-               while(c < r) {
-                    //eeb
-                    indices.push_back(vt);
-                    limit = ev + EDGE_STRIDE;
-                    while(ev < limit) indices.push_back(ev++);
-                    indices.push_back(vb++);
-                    tev = ev;
-                    nMiddlePoints = t_degree - 2;
-                    while(nMiddlePoints > 0) {
-                         indices.push_back(tev++);
-                         limit = f;
-                         f += nMiddlePoints;
-                         while(f > limit) indices.push_back(--f);
-                         f += nMiddlePoints;
-                         indices.push_back(ehb++);
-                         --nMiddlePoints;
-                    }
-                    indices.push_back(tev++);
-                    indices.push_back(ehb++);
-                    indices.push_back(vb);
-
-                    //eet
-                    indices.push_back(vt + 1);
-                    limit = eht;
-                    eht += EDGE_STRIDE;
-                    while(eht > limit) indices.push_back(--eht);
-                    eht += EDGE_STRIDE;
-                    indices.push_back(vt++);
-                    tev = ev + EDGE_STRIDE;
-                    nMiddlePoints = t_degree - 2;
-                    while(nMiddlePoints > 0) {
-                    indices.push_back(tev++);
-                         limit = f + nMiddlePoints;
-                         while(f < limit) indices.push_back(f++);
-                         indices.push_back(ev++);
-                         --nMiddlePoints;
-                    }
-                    indices.push_back(tev++);
-                    indices.push_back(ev++);
-                    indices.push_back(vb);
-
-                    ++c;
-
-                    //eot
-                    indices.push_back(vt + 1);
-                    limit = eht;
-                    eht += EDGE_STRIDE;
-                    while(eht > limit) indices.push_back(--eht);
-                    eht += EDGE_STRIDE;
-                    indices.push_back(vt++);
-                    tev = ev + (EDGE_STRIDE << 1);
-                    nMiddlePoints = t_degree - 2;
-                    while(nMiddlePoints > 0) {
-                         indices.push_back(--tev);
-                         limit = f;
-                         f += nMiddlePoints;
-                         while(f > limit) indices.push_back(--f);
-                         f += nMiddlePoints;
-                         indices.push_back(ev++);
-                         --nMiddlePoints;
-                    }
-                    indices.push_back(--tev);
-                    indices.push_back(ev++);
-                    indices.push_back(vb);
-
-                    //eob
-                    indices.push_back(vb + 1);
-                    tev = ev + (EDGE_STRIDE << 1);
-                    ev += EDGE_STRIDE;
-                    while(tev > ev) indices.push_back(--tev);
-                    indices.push_back(vt);
-                    ehb += EDGE_STRIDE;
-                    nMiddlePoints = t_degree - 2;
-                    while(nMiddlePoints > 0) {
-                         indices.push_back(--ehb);
-                         limit = f + nMiddlePoints;
-                         while(f < limit) indices.push_back(f++);
-                         indices.push_back(--tev);
-                         --nMiddlePoints;
-                    }
-                    indices.push_back(--ehb);
-                    indices.push_back(--tev);
-                    indices.push_back(vb++);
-                    ehb += EDGE_STRIDE;
-
-                    ++c;
-               }
-
-               //eeb
-               indices.push_back(vt++);//lower left point
-               limit = ev + EDGE_STRIDE;//first row
-               while(ev < limit) indices.push_back(ev++);
-               indices.push_back(vb++);
-               nMiddlePoints = t_degree - 2;//middle rows
-               while(nMiddlePoints > 0) {
-                    indices.push_back(ev++);
-                    limit = f;
-                    f += nMiddlePoints;
-                    while(f > limit) indices.push_back(--f);
-                    f += nMiddlePoints;
-                    indices.push_back(ehb++);
-                    --nMiddlePoints;
-               }
-               indices.push_back(ev++);//last row
-               indices.push_back(ehb++);
-               indices.push_back(vb++);//top point
-               
-               ++r;
-
-               c = 0;
-               while(c < r) {
-                    //oet
-                    indices.push_back(vt++);
-                    limit = ev + EDGE_STRIDE;
-                    while(ev < limit) indices.push_back(ev++);
-                    indices.push_back(vb);
-                    tev = ev;
-                    nMiddlePoints = t_degree - 2;
-                    while(nMiddlePoints > 0) {
-                         indices.push_back(eht++);
-                         limit = f + nMiddlePoints;
-                         while(f < limit) indices.push_back(f++);
-                         indices.push_back(tev++);
-                         --nMiddlePoints;
-                    }
-                    indices.push_back(eht++);
-                    indices.push_back(tev++);
-                    indices.push_back(vt);
-
-                    //oeb
-                    indices.push_back(vb++);
-                    limit = ehb + EDGE_STRIDE;
-                    while(ehb < limit) indices.push_back(ehb++);
-                    indices.push_back(vb);
-                    tev = ev + (EDGE_STRIDE << 1);
-                    nMiddlePoints = t_degree - 2;
-                    while(nMiddlePoints > 0) {
-                         indices.push_back(ev++);
-                         limit = f;
-                         f += nMiddlePoints;
-                         while(f > limit) indices.push_back(--f);
-                         f += nMiddlePoints;
-                         indices.push_back(--tev);
-                         --nMiddlePoints;
-                    }
-                    indices.push_back(ev++);
-                    indices.push_back(--tev);
-                    indices.push_back(vt);
-
-                    ++c;
-
-                    if(c == r) break;
-
-                    //oob
-                    indices.push_back(vb++);
-                    limit = ehb + EDGE_STRIDE;
-                    while(ehb < limit) indices.push_back(ehb++);
-                    indices.push_back(vb);
-                    tev = ev + (EDGE_STRIDE << 1);
-                    ev += EDGE_STRIDE;
-                    nMiddlePoints = t_degree - 2;
-                    while(nMiddlePoints > 0) {
-                         indices.push_back(--ev);
-                         limit = f + nMiddlePoints;
-                         while(f < limit) indices.push_back(f++);
-                         indices.push_back(--tev);
-                         --nMiddlePoints;
-                    }
-                    indices.push_back(--ev);
-                    indices.push_back(--tev);
-                    indices.push_back(vt);
-                    ev += EDGE_STRIDE;
-
-                    //oot
-                    indices.push_back(vb);
-                    tev = ev + (EDGE_STRIDE << 1);
-                    ev += EDGE_STRIDE;
-                    while(tev > ev) indices.push_back(--tev);
-                    indices.push_back(vt + 1);
-                    nMiddlePoints = t_degree - 2;
-                    eht += EDGE_STRIDE;
-                    while(nMiddlePoints > 0) {
-                         indices.push_back(--ev);
-                         limit = f;
-                         f += nMiddlePoints;
-                         while(f > limit) indices.push_back(--f);
-                         f += nMiddlePoints;
-                         indices.push_back(--eht);
-                         --nMiddlePoints;
-                    }
-                    indices.push_back(--ev);
-                    indices.push_back(--eht);
-                    indices.push_back(vt++);
-                    ev += EDGE_STRIDE;
-                    eht += EDGE_STRIDE;
-
-                    ++c;
-               }
-
-               //oob
-               indices.push_back(vb++);
-               limit = ehb + EDGE_STRIDE;
-               while(ehb < limit) indices.push_back(ehb++);
-               indices.push_back(vb++);
-               tev = ev + (EDGE_STRIDE << 1);
-               ev += EDGE_STRIDE;
-               nMiddlePoints = t_degree - 2;
-               while(nMiddlePoints > 0) {
-                    indices.push_back(--ev);
-                    limit = f + nMiddlePoints;
-                    while(f < limit) indices.push_back(f++);
-                    indices.push_back(--tev);
-                    --nMiddlePoints;
-               }
-               indices.push_back(--ev);
-               indices.push_back(--tev);
-               indices.push_back(vt++);
-               ev = tev + EDGE_STRIDE;
-               
-               ++r;
-          }
-
-          return std::make_tuple(std::move(points), std::move(indices));
-     }
-
-private:
-     using PointIterator = typename ControlPoints::iterator;
-     using r = std::reverse_iterator<PointIterator>;
-
-     static constexpr hpuint EDGE_STRIDE = t_degree - 1;
-     static constexpr hpuint FACE_STRIDE = SurfaceUtilsBEZ::get_number_of_control_points<t_degree>::value - 3 * t_degree;
-
-     ControlPoints m_oEdgePoints;
-     ControlPoints m_oFacePoints;
-     ControlPoints m_oVertexPoints;
-
-     //NOTE: Splits triangle into two pieces.
-     template<
-          bool t_skipEdge = false,
-          class PointIteratorIV1,
-          class PointIteratorIV2,
-          class PointIteratorOV01,
-          class PointIteratorIE0,
-          class PointIteratorIE1,
-          class PointIteratorIE2,
-          class PointIteratorOE00,
-          class PointIteratorOE01,
-          class PointIteratorOE10,
-          class PointIteratorIF0,
-          class PointIteratorOF0,
-          class PointIteratorOF1
-     >
-     void doBinaryTriangleSubdivisionStep(
-          PointIteratorIV1 iv1,
-          PointIteratorIV2 iv2,
-          PointIteratorOV01 ov01,
-          PointIteratorIE0 ie0,
-          PointIteratorIE1 ie1,
-          PointIteratorIE2 ie2,
-          PointIteratorOE00 oe00,
-          PointIteratorOE01 oe01,
-          PointIteratorOE10 oe10,
-          PointIteratorIF0 if0,
-          PointIteratorOF0 of0,
-          PointIteratorOF1 of1,
-          bool skipEdge = false
-     ) {
-          if(!skipEdge || !t_skipEdge) doBinaryEdgeSubdivisionStep(iv1, iv2, ov01, ie1, oe00, oe10);
-
-          hpuint nRows = t_degree - 2;
-          if(nRows > 0) {
-               std::vector<Point> middlePoints;
-               middlePoints.reserve(t_degree - 3);
-               while(nRows > 0) {
-                    middlePoints.clear();
-                    --nRows;
-                    of0 += nRows;
-                    of1 += nRows;
-                    auto tf0 = of0;
-                    auto tf1 = of1;
-                    auto g = if0 + nRows;
-                    *tf0 = (*ie0 + *g) * 0.5f;
-                    ++ie0;
-                    hpuint limit = nRows;
-                    auto rowLength = t_degree - 2;
-                    auto f = if0 + rowLength;
-                    while(limit > 0) {
-                         --rowLength;//TODO: ewwww
-                         --limit;
-                         auto h = f + limit;
-                         middlePoints.push_back((*h + *g) * 0.5f);
-                         f += rowLength;
-                         g = h;
-                    }
-                    *tf1 = (*g + *ie2) * 0.5f;
-                    ++ie2;
-
-                    hpuint nMiddlePoints = nRows;
-                    while(nMiddlePoints > 0) {
-                         auto m = middlePoints.begin();
-                         auto t0 = tf0 - 1;
-                         *t0 = (*tf0 + *m) * 0.5f;
-                         tf0 = t0;
-                         hpuint limit = --nMiddlePoints;
-                         while(limit > 0) {
-                              auto a = m + 1;
-                              *m = (*a + *m) * 0.5f;
-                              m = a;
-                              --limit;
-                         }
-                         auto t1 = tf1 - 1;
-                         *t1 = (*m + *tf1) * 0.5f;
-                         tf1 = t1;
-                    }
-                    *oe01 = (*tf0 + *tf1) * 0.5f;
-                    ++oe01;
-                    
-                    ++of0;
-                    ++of1;
-               }
-          }
-          *oe01 = (*ie0 + *ie2) * 0.5f;
+     /**
+      * @return Parameters (u, v) of the centers of the subdivided patches in the order in which getIndices lists the patches.  The center of a subdivided patch is the center of the parameters of its corners.
+      */
+     static std::vector<Point2D> getCenters(hpuint nSubdivisions) {
+          if(nSubdivisions == 0) return { Point2D(1.0 / 3.0) };
+
+          const hpuint nRows = 1 << nSubdivisions;
+          std::vector<Point2D> centers;
+          centers.reserve(nRows * nRows);
+          visit_triangles(nSubdivisions, [&](hpuint x0, hpuint y0, hpuint x1, hpuint y1, hpuint x2, hpuint y2) {
+               auto v = hpreal(x0 + x1 + x2) / (3 * nRows), w = hpreal(y0 + y1 + y2) / (3 * nRows);
+               centers.emplace_back(1.0 - v - w, v);
+          });
+          return centers;
      }
 
-     //Splits edge into two pieces.
-     template<
-          class PointIteratorIV0,
-          class PointIteratorIV1,
-          class PointIteratorOV1,
-          class PointIteratorIE0,
-          class PointIteratorOE0,
-          class PointIteratorOE1
-     >
-     void doBinaryEdgeSubdivisionStep(
-          PointIteratorIV0 iv0,
-          PointIteratorIV1 iv1,
-          PointIteratorOV1 ov1,
-          PointIteratorIE0 ie0,
-          PointIteratorOE0 oe0,
-          PointIteratorOE1 oe1
-     ) {
-          hpuint nMiddlePoints = t_degree - 2;
-          ControlPoints middlePoints;
-          middlePoints.reserve(nMiddlePoints);
-
-          *oe0 = (*iv0 + *ie0) * 0.5f;//NOTE: This assumes that ie contains at least one point, which means degree must be greater than 1.
-          hpuint limit = nMiddlePoints;//calculate first column of the de castlejau algorithm
-          while(limit > 0) {
-               auto a = ie0;
-               middlePoints.push_back((*a + *(++ie0)) * 0.5f);
-               --limit;
-          }
-          *oe1 = (*ie0 + *iv1) * 0.5f;
-
-          while(nMiddlePoints > 0) {//calculate the rest of the columns of the de casteljau algorithm
-               auto m = middlePoints.begin();
-               auto t0 = oe0 + 1;
-               *t0 = (*oe0 + *m) * 0.5f;
-               oe0 = t0;
-               hpuint limit = --nMiddlePoints;
-               while(limit > 0) {
-                    auto a = m + 1;
-                    *m = (*a + *m) * 0.5f;
-                    m = a;
-                    --limit;
-               }
-               auto t1 = oe1 + 1;
-               *t1 = (*m + *oe1) * 0.5f;
-               oe1 = t1;
-          }
-          *ov1 = (*oe0 + *oe1) * 0.5f;
+     /**
+      * Same as getIndices but the indices are computed only once for every number of subdivisions; later calls, also from other threads, return a reference to the same indices, which live until the program exits.
+      */
+     static const Indices& getCachedIndices(hpuint nSubdivisions) {
+          //NOTE: With 16 subdivisions, the number of indices no longer fits into an hpuint.
+          static std::array<std::once_flag, 16> flags;
+          static std::array<Indices, 16> indices;
+
+          assert(nSubdivisions > 0 && nSubdivisions < 16);
+          std::call_once(flags[nSubdivisions], [&]() { indices[nSubdivisions] = getIndices(nSubdivisions); });
+          return indices[nSubdivisions];
      }
 
-     //even row, even column, bottom triangle
-     template<bool t_skip1 = false>
-     void subdivideEEB(
-          PointIterator svt, 
-          PointIterator svb, 
-          PointIterator sev, 
-          PointIterator seh, 
-          PointIterator sf, 
-
-          PointIterator tvt, 
-          PointIterator tvm, 
-          PointIterator tvb, 
-          PointIterator tevt, 
-          PointIterator tevb, 
-          PointIterator teht, 
-          PointIterator tehb, 
-          PointIterator tft, 
-          PointIterator tfb,
-
-          PointIterator uf0,
-          PointIterator uf1,
-
-          bool skip2 = false
-     ) {
-          hpuint e = EDGE_STRIDE;
-
-          auto iv2 = svt;
-          auto iv1 = svb;
-          auto iv0 = iv1 + 1;
-
-          auto ie2 = sev;
-          auto ie0 = ie2 + e;
-          auto ie1 = seh;
-
-          auto if0 = sf;
-
-          auto ov2 = tvm;
-          auto ov0 = ov2 + 1;
-          auto ov1 = tvb + 1;
-
-          auto oe7 = tevt;
-          auto oe2 = oe7 + e;
-          auto oe8 = tevb;
-          auto oe4 = oe8 + e;
-          auto oe6 = oe4 + e;
-          auto oe0 = oe6 + e;
-          auto oe3 = teht;
-          auto oe5 = tehb;
-          auto oe1 = oe5 + e;
-
-          auto of1 = tft;
-          auto of2 = tfb;
-          auto of3 = of2 + FACE_STRIDE;
-          auto of0 = of3 + FACE_STRIDE;
+     /**
+      * @return Indices of the control points of the subdivided patches in the points written by subdivide.  The patches are listed like the leaves of a quadtree: the four patches into which a subdivision splits a patch follow each other in the order of the schedule, and the first corner of every patch is the midpoint at which it was last bisected.  The indices only depend on the degree and the number of subdivisions, not on the control points.
+      */
+     static Indices getIndices(hpuint nSubdivisions) {
+          assert(nSubdivisions > 0);
 
-          doBinaryTriangleSubdivisionStep(iv2, iv0, ov0, ie2, ie0, r(ie1 + e), oe2, r(oe4 + e), r(oe0 + e), if0, uf0, uf1);
-          doBinaryTriangleSubdivisionStep(iv2, iv1, ov2, oe2, ie2, oe4, oe7, oe3, r(oe8 + e), uf0, of1, of2, skip2);
-          doBinaryTriangleSubdivisionStep<t_skip1>(iv0, iv1, ov1, r(oe0 + e), r(ie1 + e), oe4, r(oe1 + e), r(oe6 + e), oe5, uf1, of0, of3);
+          const hpuint nRows = 1 << nSubdivisions;
+          const hpuint nSegments = nRows * t_degree;
+          Indices indices;
+          indices.reserve(getNumberOfIndices(nSubdivisions));
+          visit_triangles(nSubdivisions, [&](hpuint x0, hpuint y0, hpuint x1, hpuint y1, hpuint x2, hpuint y2) {
+               visit_control_points(x0, y0, x1, y1, x2, y2, [&](hpuint x, hpuint y) { indices.push_back(getOffset(nSegments, y) + x); });
+          });
+          return indices;
      }
 
-     //even row, even column, top triangle
-     void subdivideEET(
-          PointIterator svt, 
-          PointIterator svb, 
-          PointIterator sev, 
-          PointIterator seh, 
-          PointIterator sf, 
-
-          PointIterator tvt, 
-          PointIterator tvm, 
-          PointIterator tvb, 
-          PointIterator tevt, 
-          PointIterator tevb, 
-          PointIterator teht, 
-          PointIterator tehb, 
-          PointIterator tft, 
-          PointIterator tfb,
+     static hpuint getNumberOfIndices(hpuint nSubdivisions) { return (1 << (nSubdivisions << 1)) * N_CONTROL_POINTS; }
 
-          PointIterator uf0,
-          PointIterator uf1
-     ) {
-          hpuint e = EDGE_STRIDE;
+     //NOTE: The subdivided patches share the control points on their common edges; there are as many control points as a patch of degree 2^nSubdivisions times the degree has.
+     static hpuint getNumberOfPoints(hpuint nSubdivisions) { return SurfaceUtilsBEZ::getNumberOfControlPoints((1 << nSubdivisions) * t_degree); }
 
-          auto iv0 = svb;
-          auto iv2 = svt;
-          auto iv1 = iv2 + 1;
+     //NOTE: Size of the workspace the subdivision needs besides the output.
+     static hpuint getWorkspaceSize(hpuint nSubdivisions) { return (nSubdivisions > 1) ? getNumberOfPoints(nSubdivisions - 1) : 0; }
 
-          auto ie0 = sev;
-          auto ie1 = ie0 + e;
-          auto ie2 = seh;
-
-          auto if0 = sf;
-
-          auto ov0 = tvm;
-          auto ov1 = ov0 + 1;
-          auto ov2 = tvt + 1;
-
-          auto oe2 = tevt;
-          auto oe3 = oe2 + e;
-          auto oe4 = oe3 + e;
-          auto oe5 = oe4 + e;
-          auto oe0 = tevb;
-          auto oe1 = oe0 + e;
-          auto oe7 = teht;
-          auto oe8 = oe7 + e;
-          auto oe6 = tehb;
-
-          auto of1 = tft;
-          auto of2 = of1 + FACE_STRIDE;
-          auto of3 = of2 + FACE_STRIDE;
-          auto of0 = tfb;
+     /**
+      * Subdivide the patch nSubdivisions times and write the control points of the subdivided patches to points; see getIndices for how they are arranged into patches.  Every subdivision applies the schedule to every patch of the previous one, reading and writing the points through getCachedIndices.  Apart from the indices cached on the first call, nothing is allocated.
+      * @param[points] Room for getNumberOfPoints(nSubdivisions) points.
+      * @param[workspace] Room for getWorkspaceSize(nSubdivisions) points; the contents are overwritten.
+      */
+     void subdivide(hpuint nSubdivisions, Point* points, Point* workspace) const {
+          assert(nSubdivisions > 0);
 
-          doBinaryTriangleSubdivisionStep<true>(iv2, iv0, ov0, ie2, ie0, r(ie1 + e), oe2, oe4, r(oe0 + e), if0, uf0, uf1);
-          doBinaryTriangleSubdivisionStep(iv2, iv1, ov2, oe2, ie2, r(oe4 + e), oe7, oe3, r(oe8 + e), uf0, of1, of2);
-          doBinaryTriangleSubdivisionStep(iv0, iv1, ov1, r(oe0 + e), r(ie1 + e), r(oe4 + e), r(oe1 + e), r(oe6 + e), oe5, uf1, of0, of3);
+          std::array<hpuint, N_CONTROL_POINTS> patch;
+          for(hpuint i = 0; i < N_CONTROL_POINTS; ++i) patch[i] = i;
+
+          //NOTE: The subdivisions alternate between the output and the workspace such that the last one writes to the output.
+          const Point* source = m_controlPoints.data();
+          const hpuint* sourceIndices = patch.data();
+          auto target = ((nSubdivisions & 1) == 1) ? points : workspace;
+          for(hpuint n = 0; n < nSubdivisions; ++n) {
+               auto targetIndices = getCachedIndices(n + 1).data();
+               for(hpuint p = 0, end = 1 << (n << 1); p < end; ++p) apply(source, sourceIndices + p * N_CONTROL_POINTS, target, targetIndices + 4 * p * N_CONTROL_POINTS);
+               source = target;
+               sourceIndices = targetIndices;
+               target = (target == points) ? workspace : points;
+          }
      }
 
-     //even row, odd column, bottom triangle
-     void subdivideEOB(
-          PointIterator svt, 
-          PointIterator svb, 
-          PointIterator sev, 
-          PointIterator seh, 
-          PointIterator sf, 
-
-          PointIterator tvt, 
-          PointIterator tvm, 
-          PointIterator tvb, 
-          PointIterator tevt, 
-          PointIterator tevb, 
-          PointIterator teht, 
-          PointIterator tehb, 
-          PointIterator tft, 
-          PointIterator tfb,
-
-          PointIterator uf0,
-          PointIterator uf1
-     ) {
-          hpuint e = EDGE_STRIDE;
-
-          auto iv0 = svb;
-          auto iv1 = iv0 + 1;
-          auto iv2 = svt;
-
-          auto ie0 = sev;
-          auto ie2 = ie0 + e;
-          auto ie1 = seh;
-
-          auto if0 = sf;
-
-          auto ov0 = tvm;
-          auto ov2 = ov0 + 1;
-          auto ov1 = tvb + 1;
-
-          auto oe2 = tevt;
-          auto oe7 = oe2 + e;
-          auto oe0 = tevb;
-          auto oe6 = oe0 + e;
-          auto oe4 = oe6 + e;
-          auto oe8 = oe4 + e;
-          auto oe3 = teht;
-          auto oe1 = tehb;
-          auto oe5 = oe1 + e;
-
-          auto of1 = tft;
-          auto of0 = tfb;
-          auto of3 = of0 + FACE_STRIDE;
-          auto of2 = of3 + FACE_STRIDE;
-
-          doBinaryTriangleSubdivisionStep<true>(iv2, iv0, ov0, ie2, r(ie0 + e), ie1, r(oe2 + e), oe4, oe0, if0, uf0, uf1);
-          doBinaryTriangleSubdivisionStep(iv2, iv1, ov2, r(oe2 + e), ie2, r(oe4 + e), oe7, r(oe3 + e), r(oe8 + e), uf0, of1, of2);
-          doBinaryTriangleSubdivisionStep<true>(iv0, iv1, ov1, oe0, ie1, r(oe4 + e), oe1, r(oe6 + e), r(oe5 + e), uf1, of0, of3);
+     std::tuple<ControlPoints, Indices> subdivide(hpuint nSubdivisions) const {
+          ControlPoints points(getNumberOfPoints(nSubdivisions));
+          ControlPoints workspace(getWorkspaceSize(nSubdivisions));
+          subdivide(nSubdivisions, points.data(), workspace.data());
+          return std::make_tuple(std::move(points), getCachedIndices(nSubdivisions));
      }
 
-     //even row, odd column, top triangle
-     void subdivideEOT(
-          PointIterator svt, 
-          PointIterator svb, 
-          PointIterator sev, 
-          PointIterator seh, 
-          PointIterator sf, 
-
-          PointIterator tvt, 
-          PointIterator tvm, 
-          PointIterator tvb, 
-          PointIterator tevt, 
-          PointIterator tevb, 
-          PointIterator teht, 
-          PointIterator tehb, 
-          PointIterator tft, 
-          PointIterator tfb,
-
-          PointIterator uf0,
-          PointIterator uf1
-     ) {
-          hpuint e = EDGE_STRIDE;
-
-          auto iv0 = svb;
-          auto iv1 = svt;
-          auto iv2 = iv1 + 1;
-
-          auto ie1 = sev;
-          auto ie0 = ie1 + e;
-          auto ie2 = seh;
-
-          auto if0 = sf;
-
-          auto ov1 = tvm;
-          auto ov0 = ov1 + 1;
-          auto ov2 = tvt + 1;
-
-          auto oe5 = tevt;
-          auto oe4 = oe5 + e;
-          auto oe3 = oe4 + e;
-          auto oe2 = oe3 + e;
-          auto oe1 = tevb;
-          auto oe0 = oe1 + e;
-          auto oe8 = teht;
-          auto oe7 = oe8 + e;
-          auto oe6 = tehb;
+private:
+     static constexpr Schedule SCHEDULE{};
 
-          auto of3 = tft;
-          auto of2 = of3 + FACE_STRIDE;
-          auto of1 = of2 + FACE_STRIDE;
-          auto of0 = tfb;
+     std::array<Point, N_CONTROL_POINTS> m_controlPoints;
 
-          doBinaryTriangleSubdivisionStep(iv2, iv0, ov0, r(ie2 + e), r(ie0 + e), r(ie1 + e), r(oe2 + e), r(oe4 + e), oe0, if0, uf0, uf1);
-          doBinaryTriangleSubdivisionStep(iv2, iv1, ov2, r(oe2 + e), r(ie2 + e), oe4, r(oe7 + e), oe3, oe8, uf0, of1, of2);
-          doBinaryTriangleSubdivisionStep<true>(iv0, iv1, ov1, oe0, r(ie1 + e), oe4, r(oe1 + e), oe6, oe5, uf1, of0, of3);
+     //NOTE: The schedule is unrolled at compile time.  The control points of the patch are source[patch[i]], and the control points of the four patches are written to target[result[i]].
+     static void apply(const Point* source, const hpuint* patch, Point* target, const hpuint* result) {
+          std::array<Point, Schedule::N_POINTS> points;
+          for(hpuint i = 0; i < N_CONTROL_POINTS; ++i) points[i] = source[patch[i]];
+          average(points, std::make_index_sequence<Schedule::N_AVERAGES>());
+          store(points, target, result, std::make_index_sequence<N_SUBDIVIDED_POINTS>());
      }
 
-     //odd row, even column, bottom triangle
-     void subdivideOEB(
-          PointIterator svt, 
-          PointIterator svb, 
-          PointIterator sev, 
-          PointIterator seh, 
-          PointIterator sf, 
-
-          PointIterator tvt, 
-          PointIterator tvm, 
-          PointIterator tvb, 
-          PointIterator tevt, 
-          PointIterator tevb, 
-          PointIterator teht, 
-          PointIterator tehb, 
-          PointIterator tft, 
-          PointIterator tfb,
-
-          PointIterator uf0,
-          PointIterator uf1,
-
-          bool skip2 = false
-     ) {
-          hpuint e = EDGE_STRIDE;
-
-          auto iv0 = svt;
-          auto iv2 = svb;
-          auto iv1 = iv2 + 1;
-
-          auto ie0 = sev;
-          auto ie1 = ie0 + e;
-          auto ie2 = seh;
-
-          auto if0 = sf;
-
-          auto ov0 = tvm;
-          auto ov1 = ov0 + 1;
-          auto ov2 = tvb + 1;
-
-          auto oe0 = tevt;
-          auto oe1 = oe0 + e;
-          auto oe2 = tevb;
-          auto oe3 = oe2 + e;
-          auto oe4 = oe3 + e;
-          auto oe5 = oe4 + e;
-          auto oe6 = teht;
-          auto oe7 = tehb;
-          auto oe8 = oe7 + e;
-
-          auto of0 = tft;
-          auto of1 = tfb;
-          auto of2 = of1 + FACE_STRIDE;
-          auto of3 = of2 + FACE_STRIDE;
-
-          doBinaryTriangleSubdivisionStep<true>(iv2, iv0, ov0, ie2, ie0, ie1, oe2, oe4, r(oe0 + e), if0, uf0, uf1);
-          doBinaryTriangleSubdivisionStep(iv2, iv1, ov2, oe2, ie2, r(oe4 + e), oe7, r(oe3 + e), r(oe8 + e), uf0, of1, of2, skip2);
-          doBinaryTriangleSubdivisionStep(iv0, iv1, ov1, r(oe0 + e), ie1, r(oe4 + e), oe1, r(oe6 + e), r(oe5 + e), uf1, of0, of3);
+     template<std::size_t... i>
+     static void average(std::array<Point, Schedule::N_POINTS>& points, std::index_sequence<i...>) {
+          using expand = int[];
+          (void) expand{ 0, (points[N_CONTROL_POINTS + i] = (points[SCHEDULE.averages[i][0]] + points[SCHEDULE.averages[i][1]]) * hpreal(0.5), 0)... };
      }
 
-     //odd row, even column, top triangle
-     void subdivideOET(
-          PointIterator svt, 
-          PointIterator svb, 
-          PointIterator sev, 
-          PointIterator seh, 
-          PointIterator sf, 
-
-          PointIterator tvt, 
-          PointIterator tvm, 
-          PointIterator tvb, 
-          PointIterator tevt, 
-          PointIterator tevb, 
-          PointIterator teht, 
-          PointIterator tehb, 
-          PointIterator tft, 
-          PointIterator tfb,
-
-          PointIterator uf0,
-          PointIterator uf1,
-
-          bool skip2 = false
-     ) {
-          hpuint e = EDGE_STRIDE;
-
-          auto iv2 = svb;
-          auto iv1 = svt;
-          auto iv0 = iv1 + 1;
-
-          auto ie2 = sev;
-          auto ie0 = ie2 + e;
-          auto ie1 = seh;
-
-          auto if0 = sf;
-
-          auto ov2 = tvm;
-          auto ov0 = ov2 + 1;
-          auto ov1 = tvt + 1;
-
-          auto oe8 = tevt;
-          auto oe4 = oe8 + e;
-          auto oe6 = oe4 + e;
-          auto oe0 = oe6 + e;
-          auto oe7 = tevb;
-          auto oe2 = oe7 + e;
-          auto oe5 = teht;
-          auto oe1 = oe5 + e;
-          auto oe3 = tehb;
-
-          auto of2 = tft;
-          auto of3 = of2 + FACE_STRIDE;
-          auto of0 = of3 + FACE_STRIDE;
-          auto of1 = tfb;
-
-          doBinaryTriangleSubdivisionStep(iv2, iv0, ov0, r(ie2 + e), ie0, r(ie1 + e), oe2, r(oe4 + e), r(oe0 + e), if0, uf0, uf1);
-          doBinaryTriangleSubdivisionStep(iv2, iv1, ov2, oe2, r(ie2 + e), oe4, r(oe7 + e), oe3, oe8, uf0, of1, of2, skip2);
-          doBinaryTriangleSubdivisionStep(iv0, iv1, ov1, r(oe0 + e), r(ie1 + e), oe4, r(oe1 + e), oe6, oe5, uf1, of0, of3);
+     template<std::size_t... i>
+     static void store(const std::array<Point, Schedule::N_POINTS>& points, Point* target, const hpuint* result, std::index_sequence<i...>) {
+          using expand = int[];
+          (void) expand{ 0, (target[result[SCHEDULE.stores[i][0]]] = points[SCHEDULE.stores[i][1]], 0)... };
      }
 
-     //odd row, odd column, bottom triangle
-     void subdivideOOB(
-          PointIterator svt, 
-          PointIterator svb, 
-          PointIterator sev, 
-          PointIterator seh, 
-          PointIterator sf, 
-
-          PointIterator tvt, 
-          PointIterator tvm, 
-          PointIterator tvb, 
-          PointIterator tevt, 
-          PointIterator tevb, 
-          PointIterator teht, 
-          PointIterator tehb, 
-          PointIterator tft, 
-          PointIterator tfb,
-
-          PointIterator uf0,
-          PointIterator uf1,
-
-          bool skip2 = false
-     ) {
-          hpuint e = EDGE_STRIDE;
-
-          auto iv0 = svt;
-          auto iv1 = svb;
-          auto iv2 = iv1 + 1;
-
-          auto ie1 = sev;
-          auto ie0 = ie1 + e;
-          auto ie2 = seh;
-
-          auto if0 = sf;
-
-          auto ov1 = tvm;
-          auto ov0 = ov1 + 1;
-          auto ov2 = tvb + 1;
-
-          auto oe1 = tevt;
-          auto oe0 = oe1 + e;
-          auto oe5 = tevb;
-          auto oe4 = oe5 + e;
-          auto oe3 = oe4 + e;
-          auto oe2 = oe3 + e;
-          auto oe6 = teht;
-          auto oe8 = tehb;
-          auto oe7 = oe8 + e;
+     //NOTE: Index of the first point in the yth row of the domain points of a patch of the given degree.
+     static hpuint getOffset(hpuint degree, hpuint y) { return y * (degree + 1) - ((y * (y - 1)) >> 1); }
 
-          auto of0 = tft;
-          auto of3 = tfb;
-          auto of2 = of3 + FACE_STRIDE;
-          auto of1 = of2 + FACE_STRIDE;
-
-          doBinaryTriangleSubdivisionStep(iv2, iv0, ov0, r(ie2 + e), r(ie0 + e), ie1, r(oe2 + e), r(oe4 + e), oe0, if0, uf0, uf1);
-          doBinaryTriangleSubdivisionStep(iv2, iv1, ov2, r(oe2 + e), r(ie2 + e), oe4, r(oe7 + e), r(oe3 + e), oe8, uf0, of1, of2, skip2);
-          doBinaryTriangleSubdivisionStep<true>(iv0, iv1, ov1, oe0, ie1, oe4, oe1, oe6, r(oe5 + e), uf1, of0, of3);
+     //NOTE: Visits the control points of a patch whose corners are at the given domain points of a patch of the degree of the subdivided patches times the number of rows in the order of the control points of a patch; the domain point (x, y) has the parameters ((n - x - y) / n, x / n, y / n).
+     template<class Visitor>
+     static void visit_control_points(hpuint x0, hpuint y0, hpuint x1, hpuint y1, hpuint x2, hpuint y2, Visitor&& visit) {
+          for(hpuint k = 0; k <= t_degree; ++k) for(hpuint j = 0; j + k <= t_degree; ++j) {
+               auto i = t_degree - j - k;
+               visit(i * x0 + j * x1 + k * x2, i * y0 + j * y1 + k * y2);
+          }
      }
 
-     //odd row, odd column, top triangle
-     void subdivideOOT(
-          PointIterator svt, 
-          PointIterator svb, 
-          PointIterator sev, 
-          PointIterator seh, 
-          PointIterator sf, 
-
-          PointIterator tvt, 
-          PointIterator tvm, 
-          PointIterator tvb, 
-          PointIterator tevt, 
-          PointIterator tevb, 
-          PointIterator teht, 
-          PointIterator tehb, 
-          PointIterator tft, 
-          PointIterator tfb,
-
-          PointIterator uf0,
-          PointIterator uf1
-     ) {
-          hpuint e = EDGE_STRIDE;
-
-          auto iv0 = svt;
-          auto iv1 = iv0 + 1;
-          auto iv2 = svb;
-
-          auto ie1 = seh;
-          auto ie0 = sev;
-          auto ie2 = ie0 + e;
-
-          auto if0 = sf;
-
-          auto ov1 = tvt + 1;
-          auto ov0 = tvm;
-          auto ov2 = ov0 + 1;
-
-          auto oe0 = tevt;
-          auto oe6 = oe0 + e;
-          auto oe4 = oe6 + e;
-          auto oe8 = oe4 + e;
-          auto oe2 = tevb;
-          auto oe7 = oe2 + e;
-          auto oe1 = teht;
-          auto oe5 = oe1 + e;
-          auto oe3 = tehb;
-     
-          auto of0 = tft;
-          auto of3 = of0 + FACE_STRIDE;
-          auto of2 = of3 + FACE_STRIDE;
-          auto of1 = tfb;
-
-          doBinaryTriangleSubdivisionStep<true>(iv2, iv0, ov0, r(ie2 + e), r(ie0 + e), ie1, r(oe2 + e), oe4, oe0, if0, uf0, uf1);
-          doBinaryTriangleSubdivisionStep(iv2, iv1, ov2, r(oe2 + e), r(ie2 + e), r(oe4 + e), r(oe7 + e), r(oe3 + e), oe8, uf0, of1, of2);
-          doBinaryTriangleSubdivisionStep(iv0, iv1, ov1, oe0, ie1, r(oe4 + e), oe1, oe6, r(oe5 + e), uf1, of0, of3);
+     //NOTE: Visits the parameter triangles of the subdivided patches, given by the domain points (x, y) of their corners on the grid with 2^nSubdivisions rows, in the order of getIndices.
+     template<class Visitor>
+     static void visit_triangles(hpuint nSubdivisions, Visitor&& visit) { visit_triangles(nSubdivisions, 0, 0, 1, 0, 0, 1, visit); }
+
+     //NOTE: On the grid with twice as many rows, the midpoint of two corners is their sum and a corner is twice itself.
+     template<class Visitor>
+     static void visit_triangles(hpuint nSubdivisions, hpuint x0, hpuint y0, hpuint x1, hpuint y1, hpuint x2, hpuint y2, Visitor& visit) {
+          if(nSubdivisions == 0) return visit(x0, y0, x1, y1, x2, y2);
+          --nSubdivisions;
+          visit_triangles(nSubdivisions, x0 + x1, y0 + y1, x1 + x2, y1 + y2, x0 << 1, y0 << 1, visit);
+          visit_triangles(nSubdivisions, x0 + x1, y0 + y1, x1 << 1, y1 << 1, x1 + x2, y1 + y2, visit);
+          visit_triangles(nSubdivisions, x2 + x0, y2 + y0, x1 + x2, y1 + y2, x2 << 1, y2 << 1, visit);
+          visit_triangles(nSubdivisions, x2 + x0, y2 + y0, x0 << 1, y0 << 1, x1 + x2, y1 + y2, visit);
      }
 
 };//SurfaceSubdividerBEZ
 
+template<class Space, hpuint t_degree>
+constexpr typename SurfaceSubdividerBEZ<Space, t_degree>::Schedule SurfaceSubdividerBEZ<Space, t_degree>::SCHEDULE;
+
 }//namespace happah
 
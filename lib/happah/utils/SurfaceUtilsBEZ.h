@@ -5,7 +5,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cilk/cilk.h>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include "happah/Happah.h"
@@ -19,6 +24,8 @@ public:
      template<class Space>
      using ControlPoints = std::vector<typename Space::POINT>;
 
+     static constexpr hpuint N_LANES = 16;//NOTE: Number of queries evaluated together by the batched evaluate; enough to fill an AVX-512 register with single-precision values.
+
      template<hpuint t_degree>
      struct get_number_of_control_points : public std::integral_constant<hpuint, ((t_degree + 1) * (t_degree + 2) >> 1)> {};
 
@@ -28,89 +35,111 @@ public:
      template<hpuint t_degree, hpuint t_i0, hpuint t_i1, hpuint t_i2>
      struct get_index : public std::integral_constant<hpuint, get_number_of_control_points<t_degree>::value-get_number_of_control_points<t_degree-t_i2>::value+t_i1> {};
 
+     /**
+      * Indices, computed at compile time, of the control points of a patch of degree t_degree that are the vertices of the triangles of its control polygon.  The triangles are listed row by row, the triangles pointing up before the triangles pointing down, and are oriented like the parameter triangle.
+      */
+     //NOTE: Every triangle is rotated such that its first vertex, which provokes flat shading, is not the first vertex of another triangle wherever possible; the first vertices are a maximum matching of the triangles with their vertices.  There are t_degree * t_degree triangles but only (t_degree + 1) * (t_degree + 2) / 2 vertices, so for t_degree > 3 t_degree * (t_degree - 3) / 2 - 1 triangles have to share their first vertex.
      template<hpuint t_degree>
-     static std::vector<hpuint> buildTriangleMeshIndices() {
-          switch(t_degree) {
-          case 1: return { 0, 1, 2 };
-          case 2: return {
-                    3, 0, 1,
-                    4, 1, 2,
-                    1, 4, 3,
-                    5, 3, 4
-               };
-          case 3: return {
-                    1, 4, 0,
-                    2, 5, 1,
-                    6, 5, 2,
-                    6, 2, 3,
-                    1, 5, 4,
-                    7, 4, 5,
-                    8, 5, 6,
-                    5, 8, 7,
-                    9, 7, 8
-               };
-          case 4: return {
-                    5, 0, 1,
-                    6, 1, 2,
-                    7, 2, 3,
-                    8, 3, 4,
-                    9, 5, 6,
-                    10, 6, 7,
-                    11, 7, 8,
-                    12, 9, 10,
-                    13, 10, 11,
-                    14, 12, 13
-                    //6, 1, 5,
-                    //10, 6, 9,
-                    //13, 10, 12
-               };
-          default: {
-                    std::vector<hpuint> indices;
-                    indices.reserve(3 * get_number_of_control_polygon_triangles<t_degree>::value);
-
-                    auto index = indices.begin();
-                    hpuint i = 0;
-                    hpuint ai = i+t_degree;
-                    while(i < t_degree) {
-                         *index = i;//TODO: shouldn't this be push_back
-                         ++index;
-                         *index = ++i;
-                         ++index;
-                         *index = ++ai;
-                         ++index;
+     struct ControlPolygonPattern {
+          static_assert(t_degree > 0, "The control polygon of a patch of degree zero has no triangles.");
+          static constexpr hpuint SIZE = 3 * get_number_of_control_polygon_triangles<t_degree>::value;
+
+          hpuint indices[SIZE];
+
+          constexpr ControlPolygonPattern()
+               : indices{} {
+               hpuint n = 0;
+               for(hpuint k = 0; k < t_degree; ++k) {
+                    auto bottom = k * (t_degree + 1) - k * (k - 1) / 2;
+                    auto top = bottom + t_degree + 1 - k;
+                    for(hpuint j = 0; j + k < t_degree; ++j) {
+                         indices[n++] = bottom + j;
+                         indices[n++] = bottom + j + 1;
+                         indices[n++] = top + j;
+                    }
+                    for(hpuint j = 0; j + k + 1 < t_degree; ++j) {
+                         indices[n++] = bottom + j + 1;
+                         indices[n++] = top + j + 1;
+                         indices[n++] = top + j;
+                    }
+               }
+
+               hpuint owners[N_VERTICES] = {};
+               for(auto& owner : owners) owner = UNULL;
+               for(hpuint t = 0; t < N_TRIANGLES; ++t) {
+                    bool visited[N_VERTICES] = {};
+                    match(t, owners, visited);
+               }
+               for(hpuint v = 0; v < N_VERTICES; ++v) if(owners[v] != UNULL) {
+                    auto triangle = indices + 3 * owners[v];
+                    while(triangle[0] != v) {
+                         auto temp = triangle[0];
+                         triangle[0] = triangle[1];
+                         triangle[1] = triangle[2];
+                         triangle[2] = temp;
+                    }
+               }
+          }
+
+     private:
+          static constexpr hpuint N_TRIANGLES = get_number_of_control_polygon_triangles<t_degree>::value;
+          static constexpr hpuint N_VERTICES = get_number_of_control_points<t_degree>::value;
+
+          //NOTE: Looks for an augmenting path that gives the triangle t a first vertex of its own.
+          constexpr bool match(hpuint t, hpuint (&owners)[N_VERTICES], bool (&visited)[N_VERTICES]) const {
+               for(hpuint i = 0; i < 3; ++i) {
+                    auto v = indices[3 * t + i];
+                    if(visited[v]) continue;
+                    visited[v] = true;
+                    if(owners[v] == UNULL || match(owners[v], owners, visited)) {
+                         owners[v] = t;
+                         return true;
                     }
-                    ++i;
-                    hpuint d = t_degree;
-                    while(d > 1) {
-                         hpuint bi = i-d;
-                         --d;
-                         hpuint end = i+d;
-                         ai = end;
-                         while(i < end) {
-                              hpuint oi = i;
-                              ++i;
-
-                              *index = oi;
-                              ++index;
-                              *index = i;
-                              ++index;
-                              *index = ++ai;
-                              ++index;
-
-                              *index = oi;
-                              ++index;
-                              *index = i;
-                              ++index;
-                              *index = bi++;
-                              ++index;
-                         }
-                         ++i;
-                    }//TODO: fix that vertices are in counterclockwise order
-                    return indices;
-                    //TODO: arrange provoking vertices correctly
-                    //NOTE: If t_degree = 4, there are 16 triangle and 15 vertices which means we cannot map each vertex to a single triangle, which is necessary for flat shading (one of the vertices needs to a provoking vertex).  If t_degree = 5, there are 25 triangles but only 21 vertices.  The general solution must duplicate some vertices, namely, t_degree*t_degree-(t_degree+1)*(t_degree+2)/2=t_degree*(t_degree-3)/2-1 of them.
                }
+               return false;
           }
+
+     };//ControlPolygonPattern
+
+     /**
+      * Matrix, computed at compile time, whose rth row holds the weights of the control points of a patch of degree t_degree in the rth control point of the same patch elevated to degree t_degree + t_n.  The weight of the control point with indices (i0, i1, i2) in the elevated control point with indices (j0, j1, j2) is the product of the multinomials of (i0, i1, i2) and (j0 - i0, j1 - i1, j2 - i2) divided by the multinomial of (j0, j1, j2).
+      */
+     template<hpuint t_degree, hpuint t_n>
+     struct ElevationMatrix {
+          static constexpr hpuint N_COLUMNS = get_number_of_control_points<t_degree>::value;
+          static constexpr hpuint N_ROWS = get_number_of_control_points<t_degree + t_n>::value;
+
+          hpreal coefficients[N_ROWS][N_COLUMNS];
+
+          constexpr ElevationMatrix()
+               : coefficients{} {
+               hpuint r = 0;
+               for(hpuint k = 0; k <= t_degree + t_n; ++k) for(hpuint j = 0; j + k <= t_degree + t_n; ++j, ++r) {
+                    hpuint c = 0;
+                    for(hpuint l = 0; l <= t_degree; ++l) for(hpuint i = 0; i + l <= t_degree; ++i, ++c) if(i <= j && l <= k) coefficients[r][c] = hpreal(MathUtils::munom(t_degree, i, l) * MathUtils::munom(t_n, j - i, k - l)) / hpreal(MathUtils::munom(t_degree + t_n, j, k));
+               }
+          }
+
+     };//ElevationMatrix
+
+     template<hpuint t_degree>
+     static std::vector<hpuint> buildTriangleMeshIndices() {
+          static constexpr ControlPolygonPattern<t_degree> pattern{};
+          return std::vector<hpuint>(pattern.indices, pattern.indices + pattern.SIZE);
+     }
+
+     /**
+      * Same as getEvaluationMatrix but the matrix is computed only once for every degree and number of samples; later calls, also from other threads, return a reference to the same matrix, which lives until the program exits.
+      */
+     template<hpuint t_degree>
+     static const std::vector<hpreal>& getCachedEvaluationMatrix(hpuint nSamples) {
+          static std::mutex mutex;
+          static std::unordered_map<hpuint, std::vector<hpreal> > matrices;
+
+          std::lock_guard<std::mutex> lock(mutex);
+          auto i = matrices.find(nSamples);
+          if(i == matrices.end()) i = matrices.emplace(nSamples, getEvaluationMatrix<t_degree>(nSamples)).first;
+          return i->second;
      }
 
      /**
@@ -119,45 +148,50 @@ public:
       */
      template<hpuint t_degree>
      static std::vector<hpreal> getEvaluationMatrix(hpuint nSamples) {
-          std::vector<hpreal> matrix;
+          static constexpr hpuint nControlPoints = get_number_of_control_points<t_degree>::value;
+
+          std::vector<hpreal> matrix(nSamples * (nSamples + 1) / 2 * nControlPoints);
+          auto row = matrix.data();
           sample(nSamples, [&] (hpreal u, hpreal v, hpreal w) {
-               hpuint coefficient = 1;
-               hpuint k = 0;
-               hpreal wk = 1.0;
-               while(k < t_degree) {
-                    hpuint limit = t_degree - k;
-                    hpuint i = limit;
-                    hpreal ui = MathUtils::pow(u, i);
-                    matrix.push_back(coefficient * ui * wk);//j=0
-                    coefficient *= i;
-                    --i;
-                    ui = MathUtils::pow(u, i);//NOTE: Here we could also do 'ui /= u' but to avoid division by zero, we recalculate u^i.
-                    hpuint j = 1;
-                    hpreal vj = v;
-                    while(j < limit) {
-                         matrix.push_back(coefficient * ui * vj * wk);
-                         coefficient *= i;
-                         --i;
-                         ui = MathUtils::pow(u, i);
-                         ++j;
-                         coefficient /= j;
-                         vj *= v;
-                    }
-                    matrix.push_back(coefficient * vj * wk);//i=0
-                    coefficient *= limit;
-                    wk *= w;
-                    ++k;
-                    coefficient /= k;
-               }
-               matrix.push_back(wk);//k=degree
+               evaluateBasis<t_degree>(u, v, w, row);
+               row += nControlPoints;
           });
-          return std::move(matrix);
+          return matrix;
      }
 
+     //NOTE: Returns the unit normal of the tangent plane spanned by the partial derivatives or the zero vector if the partial derivatives are parallel.
+     static hpvec3 getNormal(const hpvec3& partialU, const hpvec3& partialV) {
+          auto normal = glm::cross(partialU, partialV);
+          auto length = glm::length(normal);
+          return (length > 0) ? normal / length : normal;
+     }
+
+     template<class Vector>
+     static Vector getNormal(const Vector& partialU, const Vector& partialV) { return Vector(0.0); }//NOTE: Normals are only defined in three dimensions.
+
      static hpuint getNumberOfControlPoints(hpuint degree) { return (degree + 1) * (degree + 2) >> 1; }
      
      static hpuint getNumberOfControlPolygonTriangles(hpuint degree) { return degree * degree; }
 
+     /**
+      * Bound the second directional derivatives of the patch along the edges of the parameter triangle by the degree times the degree minus one times the largest second difference of the control net.  The piecewise linear interpolant of the samples on a uniform grid with n segments per edge deviates from the patch by at most a sixth of the bound divided by n squared.
+      * @param[controlPoints] Iterator to the first control point of the patch.
+      */
+     template<class Space, hpuint t_degree, class Iterator>
+     static hpreal getSecondDerivativeBound(Iterator controlPoints) {
+          if(t_degree < 2) return 0.0;
+
+          auto offset = [](hpuint k) { return k * (t_degree + 1) - k * (k - 1) / 2; };
+          auto point = [&](hpuint j, hpuint k) -> const Point<Space>& { return *(controlPoints + (offset(k) + j)); };
+          hpreal max = 0.0;
+          for(hpuint k = 0; k + 2 <= t_degree; ++k) for(hpuint j = 0; j + k + 2 <= t_degree; ++j) {
+               max = std::max(max, glm::length(point(j, k) - hpreal(2.0) * point(j + 1, k) + point(j + 2, k)));
+               max = std::max(max, glm::length(point(j, k) - hpreal(2.0) * point(j, k + 1) + point(j, k + 2)));
+               max = std::max(max, glm::length(point(j + 2, k) - hpreal(2.0) * point(j + 1, k + 1) + point(j, k + 2)));
+          }
+          return hpreal(t_degree * (t_degree - 1)) * max;
+     }
+
      template<hpuint t_degree>
      static hpuint getIndex(hpuint i0, hpuint i1, hpuint i2) { return get_number_of_control_points<t_degree>::value-getNumberOfControlPoints(t_degree-i2)+i1; }
 
@@ -189,12 +223,131 @@ public:
                return points[0];
           }
      }
-     //TODO: implement derivative by returning intermediate points array
+
+     /**
+      * Evaluate patches[q] at (us[q], vs[q], 1 - us[q] - vs[q]) for every query q with the de Casteljau algorithm and store the result in points[q].
+      * The queries are processed in blocks of N_LANES.  The control points of a block are transposed into one array per coordinate so that every step of the algorithm is a loop over the lanes the compiler can vectorize.  The last block is padded with copies of the last query.
+      * @param[in] controlPoints Random access iterator to the control points of the first patch; the control points of the pth patch start at controlPoints + p * get_number_of_control_points<t_degree>::value.
+      * @param[out] partialsU,partialsV If not null, the partial derivatives with respect to u and v are stored here; see evaluateWithPartials.
+      */
+     template<class Space, hpuint t_degree, class Iterator>
+     static void evaluate(Iterator controlPoints, const hpuint* patches, const hpreal* us, const hpreal* vs, hpuint nQueries, Point<Space>* points, Vector<Space>* partialsU = nullptr, Vector<Space>* partialsV = nullptr) {
+          static constexpr hpuint DIMENSION = Space::DIMENSION;
+          static constexpr hpuint nControlPoints = get_number_of_control_points<t_degree>::value;
+
+          auto nBlocks = (nQueries + N_LANES - 1) / N_LANES;
+          cilk_for(hpuint block = 0; block < nBlocks; ++block) {
+               auto offset = block * N_LANES;
+               auto nValid = (nQueries - offset < N_LANES) ? nQueries - offset : N_LANES;
+               alignas(64) hpreal u[N_LANES], v[N_LANES], w[N_LANES];
+               alignas(64) hpreal b[DIMENSION][nControlPoints][N_LANES];
+
+               for(hpuint l = 0; l < N_LANES; ++l) {
+                    auto q = offset + std::min(l, nValid - 1);
+                    u[l] = us[q];
+                    v[l] = vs[q];
+                    w[l] = 1.0 - us[q] - vs[q];
+                    auto patch = controlPoints + patches[q] * nControlPoints;
+                    for(hpuint i = 0; i < nControlPoints; ++i) {
+                         auto& point = *(patch + i);
+                         for(hpuint c = 0; c < DIMENSION; ++c) b[c][i][l] = point[c];
+                    }
+               }
+
+               if(t_degree == 0 && partialsU) for(hpuint l = 0; l < nValid; ++l) {
+                    partialsU[offset + l] = Vector<Space>(0.0);
+                    partialsV[offset + l] = Vector<Space>(0.0);
+               }
+
+               //NOTE: The points of the next level overwrite the points of the current level; see the scalar evaluate above for the order of the rows.
+               for(hpuint d = t_degree; d > 0; --d) {
+                    if(d == 1 && partialsU) for(hpuint l = 0; l < nValid; ++l) for(hpuint c = 0; c < DIMENSION; ++c) {
+                         partialsU[offset + l][c] = t_degree * (b[c][0][l] - b[c][2][l]);
+                         partialsV[offset + l][c] = t_degree * (b[c][1][l] - b[c][2][l]);
+                    }
+                    hpuint p = 0;
+                    hpuint q1 = 0;
+                    for(hpuint rowLength = d; rowLength > 0; --rowLength) {
+                         for(hpuint j = 0; j < rowLength; ++j, ++p, ++q1) {
+                              auto q2 = q1 + rowLength + 1;
+                              for(hpuint c = 0; c < DIMENSION; ++c) {
+                                   #pragma simd
+                                   for(hpuint l = 0; l < N_LANES; ++l) {
+                                        hpreal temp = u[l] * b[c][q1][l] + w[l] * b[c][q2][l];
+                                        temp += v[l] * b[c][q1 + 1][l];
+                                        b[c][p][l] = temp;
+                                   }
+                              }
+                         }
+                         ++q1;
+                    }
+               }
+
+               for(hpuint l = 0; l < nValid; ++l) for(hpuint c = 0; c < DIMENSION; ++c) points[offset + l][c] = b[c][0][l];
+          }
+     }
+
+     /**
+      * Elevate the patch from degree t_degree to degree t_degree + t_n.
+      * @param[controlPoints] Iterator to the first control point of the patch.
+      * @param[elevated] Room for the control points of the elevated patch, which are ordered like the control points of the patch.
+      */
+     template<class Space, hpuint t_degree, hpuint t_n, class Iterator>
+     static void elevate(Iterator controlPoints, Point<Space>* elevated) {
+          static constexpr ElevationMatrix<t_degree, t_n> matrix;
+
+          for(hpuint r = 0; r < matrix.N_ROWS; ++r) {
+               Point<Space> point(0.0);
+               for(hpuint c = 0; c < matrix.N_COLUMNS; ++c) point += matrix.coefficients[r][c] * *(controlPoints + c);
+               elevated[r] = point;
+          }
+     }
+
+     /**
+      * Evaluate the patch and its partial derivatives with respect to u and v, where w = 1 - u - v, in one pass of the de Casteljau algorithm.  The partial derivatives are the differences of the three points of the last but one level scaled by the degree.
+      * @return Point, partial derivative with respect to u, and partial derivative with respect to v.
+      */
+     template<class Space, hpuint t_degree>
+     static std::tuple<Point<Space>, Vector<Space>, Vector<Space> > evaluateWithPartials(hpreal u, hpreal v, hpreal w, const ControlPoints<Space>& controlPoints) { return evaluateWithPartials<Space, t_degree>(u, v, w, controlPoints.begin()); }
+
+     //NOTE: Same as above but the control points of the patch start at the given iterator.
+     template<class Space, hpuint t_degree, class Iterator>
+     static std::tuple<Point<Space>, Vector<Space>, Vector<Space> > evaluateWithPartials(hpreal u, hpreal v, hpreal w, Iterator controlPoints) {
+          if(t_degree == 0) return std::make_tuple(*controlPoints, Vector<Space>(0.0), Vector<Space>(0.0));
+
+          Point<Space> points[get_number_of_control_points<t_degree>::value];
+          std::copy(controlPoints, controlPoints + get_number_of_control_points<t_degree>::value, points);
+          for(hpuint d = t_degree; d > 1; --d) {
+               const Point<Space>* q1 = points;
+               const Point<Space>* q3 = q1 + d;
+               const Point<Space>* q2 = q3 + 1;
+               evaluate<Space>(points, q1, q2, q3, d, u, v, w);
+          }
+
+          Point<Space> point = u * points[0] + w * points[2];
+          point += v * points[1];
+          return std::make_tuple(point, hpreal(t_degree) * (points[0] - points[2]), hpreal(t_degree) * (points[1] - points[2]));
+     }
+
+     /**
+      * Evaluate all Bernstein polynomials of degree t_degree at (u, v, w) in one sweep: the powers of u, v, and w are computed once, and the multinomials come from the table in MathUtils.  Use this instead of evaluating one Bernstein polynomial at a time when all of them are needed, for example, to build evaluation matrices or constraints.
+      * @param[basis] Room for get_number_of_control_points<t_degree>::value values, which are ordered like the control points of a patch; the value of B^n_{ijk} is multiplied with the control point with weight u^i v^j w^k.
+      */
+     template<hpuint t_degree>
+     static void evaluateBasis(hpreal u, hpreal v, hpreal w, hpreal* basis) {
+          hpreal us[t_degree + 1], vs[t_degree + 1], ws[t_degree + 1];
+          us[0] = vs[0] = ws[0] = 1.0;
+          for(hpuint i = 1; i <= t_degree; ++i) {
+               us[i] = us[i - 1] * u;
+               vs[i] = vs[i - 1] * v;
+               ws[i] = ws[i - 1] * w;
+          }
+          for(hpuint k = 0; k <= t_degree; ++k) for(hpuint j = 0; j + k <= t_degree; ++j) *(basis++) = hpreal(MathUtils::munom<false>(t_degree, j, k)) * us[t_degree - j - k] * vs[j] * ws[k];
+     }
 
      /**
       * Evaluate the Bernstein polynomial B^n_{ij}.
       */
-     //TODO: create tables for degree 0,1,2,3,4 for calculation of munom,binom in curveutilsbez, same for pow
      template<hpuint t_degree, bool t_check = true>
      static hpreal evaluate(hpreal u, hpreal v, hpuint i, hpuint j) { return evaluate<t_degree, t_check>(u, v, 1.0 - u - v, i, j, t_degree - i - j); }
 
@@ -21,15 +21,21 @@ void visit_pairs(Iterator begin, hpuint n, hpuint stride, Visitor&& visit) {
 template<class T, class Visitor>
 void visit_pairs(const std::vector<T>& ts, Visitor&& visit) { visit_pairs(ts.begin(), ts.size() / 2, 2, std::forward<Visitor>(visit)); }
 
-template<class Visitor>
-void visit_rings(const Indices& offsets, const Indices& indices, Visitor&& visit) {
-     auto o = offsets.begin();
+//NOTE: Visits the range [offsets[v], offsets[v + 1]) of indices in compressed sparse row format.
+template<class Index, class Visitor>
+void visit_ring(const std::vector<Index>& offsets, const std::vector<Index>& indices, hpsize v, Visitor&& visit) {
+     auto i = indices.begin();
+     visit(i + offsets[v], i + offsets[v + 1]);
+}
+
+template<class Index, class Visitor>
+void visit_rings(const std::vector<Index>& offsets, const std::vector<Index>& indices, Visitor&& visit) {
      auto i = indices.begin();
      for(auto o = offsets.begin(), end = offsets.end(); o + 1 != end; ++o) visit(i + *o, i + *(o + 1));
 }
 
-template<class Visitor>
-void visit_rings(const Indices& centers, const Indices& offsets, const Indices& indices, Visitor&& visit) {
+template<class Index, class Visitor>
+void visit_rings(const std::vector<Index>& centers, const std::vector<Index>& offsets, const std::vector<Index>& indices, Visitor&& visit) {
      auto o = offsets.begin();
      auto i = indices.begin();
      for(auto center : centers) {
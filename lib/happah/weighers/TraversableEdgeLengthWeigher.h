@@ -19,14 +19,22 @@ public:
      static const Weight MAX_WEIGHT;
 
      TraversableEdgeLengthWeigher(const Mesh& mesh)
-          : m_mesh(mesh), m_removed(mesh.getNumberOfEdges()) {}
+          : m_mesh(mesh), m_removed(mesh.getNumberOfEdges()), m_version(mesh.getVersion()) { m_mesh.retainChanges(m_version); }
 
      TraversableEdgeLengthWeigher(const Mesh& mesh, boost::dynamic_bitset<> removed)
-          : m_mesh(mesh), m_removed(std::move(removed)) {}
+          : m_mesh(mesh), m_removed(std::move(removed)), m_version(mesh.getVersion()) { m_mesh.retainChanges(m_version); }
 
      template<class Iterator>
      TraversableEdgeLengthWeigher(const Mesh& mesh, Iterator begin, Iterator end)
-          : m_mesh(mesh), m_removed(mesh.getNumberOfEdges()) { removeVertices(begin, end); }
+          : m_mesh(mesh), m_removed(mesh.getNumberOfEdges()), m_version(mesh.getVersion()) {
+          m_mesh.retainChanges(m_version);
+          removeVertices(begin, end);
+     }
+
+     TraversableEdgeLengthWeigher(const TraversableEdgeLengthWeigher& weigher)
+          : m_mesh(weigher.m_mesh), m_removed(weigher.m_removed), m_version(weigher.m_version) { m_mesh.retainChanges(m_version); }
+
+     ~TraversableEdgeLengthWeigher() { m_mesh.releaseChanges(m_version); }
 
      bool isTraversable(hpuint e) const { return !m_removed[e]; }
 
@@ -50,6 +58,20 @@ public:
 
      void unremoveVertex(hpuint v) { this->template set<false>(v); }
 
+     //NOTE: Carries the removed flags along with edges that moved since the last update.  New edges are traversable.
+     void update() {
+          resize(m_mesh.getNumberOfEdges());
+          visit_changes(m_mesh, m_version, [&](const MeshChanges& changes) {
+               for(auto& move : changes.moves) {
+                    m_removed[move.second] = m_removed[move.first];
+                    m_removed[move.first] = false;
+               }
+          });
+          m_mesh.releaseChanges(m_version);
+          m_version = m_mesh.getVersion();
+          m_mesh.retainChanges(m_version);
+     }
+
      Weight weigh(hpuint v0, hpuint v1) const { 
           if(auto i = m_mesh.getEdgeIndex(v0, v1)) return weigh(v0, v1, *i);
           else return MAX_WEIGHT;
@@ -71,10 +93,11 @@ public:
 protected:
      const Mesh& m_mesh;
      boost::dynamic_bitset<> m_removed;
+     hpuint m_version;
 
      template<bool value>
      void set(hpuint v) {
-          visit_spokes(m_mesh, v, [&](const Edge& edge) {
+          visit_spokes(m_mesh, m_mesh.getOutgoing(v), [&](const Edge& edge) {
                removeEdge(edge.opposite);
                removeEdge(m_mesh.getEdge(edge.opposite).opposite);
           });